@@ -0,0 +1,46 @@
+#pragma once
+#include <mutex>
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+// Picks the input resolution of each request for a dynamic-shape model so latency stays
+// under an SLO. Latency of every resolution is tracked online (EWMA of measured runs);
+// a request waiting behind queueDepth others is expected to finish after roughly
+// (queueDepth / workers + 1) runs, so under load the controller steps down to a smaller
+// resolution at once and steps back up one level at a time when there is headroom again.
+// Sizes that are not running keep their last estimate only for a while: every measured
+// run pulls them toward the measured size's latency scaled by pixel count, so one slow
+// spell at a large size does not keep the controller at a small one for good.
+class ResolutionController
+{
+public:
+    // sizes in any order; they are kept smallest first
+    ResolutionController(std::vector<cv::Size> sizes, double sloMs, int workers = 1);
+
+    cv::Size select(size_t queueDepth);
+    void record(const cv::Size &size, double latencyMs);
+
+    const std::vector<cv::Size> &sizes() const { return candidates; }
+    // EWMA latency per size (estimated from another size's until measured) and requests per size
+    std::vector<double> latencies() const;
+    std::vector<uint64_t> counts() const;
+
+private:
+    std::vector<cv::Size> candidates;
+    double sloMs;
+    int workers;
+    double alpha = 0.2;
+    // stepping up needs the larger size to fit with this much of the SLO to spare
+    double upHeadroom = 0.7;
+    // weight of the scaled estimate in the other sizes' EWMA per measured run
+    double staleDecay = 0.05;
+
+    mutable std::mutex mutex;
+    std::vector<double> ewma;
+    std::vector<bool> measured;
+    std::vector<uint64_t> selected;
+    size_t current;
+
+    double estimate(size_t index) const;
+    size_t indexOf(const cv::Size &size) const;
+};
@@ -0,0 +1,85 @@
+#pragma once
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <utility>
+
+// Thread-safe FIFO with a fixed capacity. tryPush never blocks, so a producer can
+// shed load instead of waiting when consumers fall behind.
+template <typename T>
+class BoundedQueue
+{
+public:
+    explicit BoundedQueue(size_t capacity) : capacity(capacity) {}
+
+    // false if the queue is full or closed
+    bool tryPush(T item)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (closed || items.size() >= capacity)
+                return false;
+            items.push_back(std::move(item));
+        }
+        notEmpty.notify_one();
+        return true;
+    }
+
+    // blocks while full, false once closed
+    bool push(T item)
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            notFull.wait(lock, [this]
+                         { return closed || items.size() < capacity; });
+            if (closed)
+                return false;
+            items.push_back(std::move(item));
+        }
+        notEmpty.notify_one();
+        return true;
+    }
+
+    // blocks while empty, false once closed and drained
+    bool pop(T &item)
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            notEmpty.wait(lock, [this]
+                          { return closed || !items.empty(); });
+            if (items.empty())
+                return false;
+            item = std::move(items.front());
+            items.pop_front();
+        }
+        notFull.notify_one();
+        return true;
+    }
+
+    void close()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            closed = true;
+        }
+        notEmpty.notify_all();
+        notFull.notify_all();
+    }
+
+    size_t size() const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return items.size();
+    }
+
+    size_t maxSize() const { return capacity; }
+
+private:
+    size_t capacity;
+    std::deque<T> items;
+    bool closed = false;
+    mutable std::mutex mutex;
+    std::condition_variable notEmpty;
+    std::condition_variable notFull;
+};
@@ -0,0 +1,51 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+#include "utils.h"
+
+// Cascade inference: a cheap screener (e.g. yolov8n at 320x320) runs on every frame, and the
+// expensive models only on frames where it finds a candidate, or only on the region around
+// its candidates. The screener's threshold should favour recall: a frame it misses loses
+// every detection the expensive models would have made on it.
+namespace cascade
+{
+    struct Options
+    {
+        // screener detections at or above this confidence trigger the expensive models
+        float screenConf = 0.1f;
+        // screener classes that trigger, empty means any
+        std::vector<int> classes;
+        // run the expensive models on the region around the candidates instead of the frame
+        bool regions = false;
+        // added on each side of a candidate, as a fraction of its size
+        float regionMargin = 0.25f;
+        // regions covering more than this fraction of the frame run on the whole frame
+        float maxRegionFraction = 0.5f;
+    };
+
+    // frames seen and what the expensive models ran on
+    struct Stats
+    {
+        uint64_t frames = 0;
+        uint64_t fullRuns = 0;
+        uint64_t regionRuns = 0;
+        // pixels the expensive models saw over pixels of all frames
+        uint64_t framePixels = 0;
+        uint64_t heavyPixels = 0;
+    };
+
+    // part of a frame of frameSize the expensive models should run on: empty when no screener
+    // detection triggers, the whole frame unless regions are on and the candidates are small
+    cv::Rect region(const std::vector<Yolov8Result> &screened, const cv::Size &frameSize, const Options &options);
+
+    // moves results predicted on a crop at offset into frame coordinates; lazy masks are
+    // computed first, their prototypes map the crop
+    void offsetResults(std::vector<Yolov8Result> &results, const cv::Point &offset);
+
+    // detections of reference matched one to one by a detection of the same class in
+    // candidate with IoU of at least iou, highest confidence first
+    size_t matchDetections(const std::vector<Yolov8Result> &reference, const std::vector<Yolov8Result> &candidate,
+                           float iou = 0.5f);
+}
@@ -0,0 +1,34 @@
+#pragma once
+#include <string>
+#include <vector>
+
+// Reports files that are finished being written into one directory, using inotify:
+// IN_CLOSE_WRITE for files written in place and IN_MOVED_TO for files renamed into it
+// (the usual atomic drop), so half-written files are never picked up. When the kernel's
+// event queue overflows, events are lost and every file in the directory is reported
+// instead; callers skip the ones they already handled. Linux only.
+class FolderWatcher
+{
+public:
+    explicit FolderWatcher(const std::string &dir);
+    ~FolderWatcher();
+    FolderWatcher(const FolderWatcher &) = delete;
+    FolderWatcher &operator=(const FolderWatcher &) = delete;
+
+    // blocks for the first new file, then keeps collecting files that arrive within
+    // batchWindowMs of the previous one, up to maxFiles, so a burst costs one wakeup;
+    // false once stop() was called
+    bool next(std::vector<std::string> &paths, int batchWindowMs, size_t maxFiles);
+    // wakes next(); async-signal-safe, so it can be called from a SIGINT handler
+    void stop();
+
+private:
+    std::string dir;
+    int inotifyFd = -1;
+    int stopFds[2] = {-1, -1};
+
+    // appends the paths of complete events in one read, false if stopped
+    bool readEvents(std::vector<std::string> &paths, int timeoutMs, bool &timedOut);
+    // appends every file in dir, after an overflow lost events
+    void rescan(std::vector<std::string> &paths);
+};
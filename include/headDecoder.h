@@ -0,0 +1,153 @@
+#pragma once
+#include <algorithm>
+#include <functional>
+#include <utility>
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+// candidates decoded from one raw [1,4+nc(+nm),A] head, before NMS
+struct HeadCandidates
+{
+    std::vector<cv::Rect> boxes;
+    std::vector<float> confs;
+    std::vector<int> classIds;
+    // mask coefficients per candidate, segmentation heads only
+    std::vector<std::vector<float>> proposals;
+
+    void clear()
+    {
+        boxes.clear();
+        confs.clear();
+        classIds.clear();
+        proposals.clear();
+    }
+};
+
+struct DecodeParams
+{
+    float confThreshold = 0.3f;
+    // keep at most topK candidates (highest confidence), 0 keeps all
+    int topK = 0;
+    // class planes to read, in ascending order
+    const std::vector<int> *classes = nullptr;
+    // best-class scratch owned by the caller, reusable across frames
+    std::vector<float> *bestConfs = nullptr;
+    std::vector<int> *bestClassIds = nullptr;
+};
+
+typedef void (*HeadDecoder)(const float *output, int classNums, int maskNums, int anchors,
+                            const DecodeParams &params, HeadCandidates &candidates);
+
+// Decodes a raw head where every channel is a contiguous plane of A anchors. NC, NM and
+// A fix the class count, mask coefficient count and anchor count at compile time so the
+// loop bounds are constants; 0 takes the runtime argument instead (the generic decoder).
+template <int NC, int NM, int A>
+void decodeHead(const float *output, int classNums, int maskNums, int anchors,
+                const DecodeParams &params, HeadCandidates &candidates)
+{
+    const int nc = NC > 0 ? NC : classNums;
+    const int nm = NM > 0 ? NM : maskNums;
+    const int na = A > 0 ? A : anchors;
+
+    std::vector<float> &bestConfs = *params.bestConfs;
+    std::vector<int> &bestClassIds = *params.bestClassIds;
+    bestConfs.resize(na);
+    bestClassIds.resize(na);
+    float *__restrict best = bestConfs.data();
+    int *__restrict bestIds = bestClassIds.data();
+    // running max over the class planes, four planes per pass so the best arrays are
+    // read and written a quarter as often; branchless so the anchor loop vectorizes
+    const int *classList = params.classes && (int)params.classes->size() < nc ? params.classes->data() : nullptr;
+    const int classCount = classList ? (int)params.classes->size() : nc;
+    auto classAt = [&](int k)
+    { return classList ? classList[k] : k; };
+    std::fill(best, best + na, 0.0f);
+    std::fill(bestIds, bestIds + na, 0);
+    int k = 0;
+    for (; k + 4 <= classCount; k += 4)
+    {
+        const int c0 = classAt(k), c1 = classAt(k + 1), c2 = classAt(k + 2), c3 = classAt(k + 3);
+        const float *__restrict p0 = output + (size_t)(4 + c0) * na;
+        const float *__restrict p1 = output + (size_t)(4 + c1) * na;
+        const float *__restrict p2 = output + (size_t)(4 + c2) * na;
+        const float *__restrict p3 = output + (size_t)(4 + c3) * na;
+        for (int i = 0; i < na; i++)
+        {
+            // max/select arithmetic instead of branches, which SSE2 vectorizes too;
+            // ties keep the lower class id, as a plane-by-plane scan would
+            const float v0 = p0[i], v1 = p1[i], v2 = p2[i], v3 = p3[i];
+            const float conf01 = std::max(v0, v1), conf23 = std::max(v2, v3);
+            const int id01 = c0 + (int)(v1 > v0) * (c1 - c0);
+            const int id23 = c2 + (int)(v3 > v2) * (c3 - c2);
+            const float conf = std::max(conf01, conf23);
+            const int id = id01 + (int)(conf23 > conf01) * (id23 - id01);
+            const int greater = (int)(conf > best[i]);
+            bestIds[i] += greater * (id - bestIds[i]);
+            best[i] = std::max(best[i], conf);
+        }
+    }
+    for (; k < classCount; k++)
+    {
+        const int classId = classAt(k);
+        const float *__restrict plane = output + (size_t)(4 + classId) * na;
+        for (int i = 0; i < na; i++)
+        {
+            const float v = plane[i];
+            bestIds[i] += (int)(v > best[i]) * (classId - bestIds[i]);
+            best[i] = std::max(best[i], v);
+        }
+    }
+
+    // with topK set, a bounded min-heap keeps only the strongest candidates for NMS
+    std::vector<std::pair<float, int>> selected;
+    auto heapCompare = std::greater<std::pair<float, int>>();
+    for (int i = 0; i < na; i++)
+    {
+        if (best[i] <= params.confThreshold)
+            continue;
+        if (params.topK <= 0)
+        {
+            selected.emplace_back(best[i], i);
+            continue;
+        }
+        if ((int)selected.size() == params.topK)
+        {
+            if (best[i] <= selected.front().first)
+                continue;
+            std::pop_heap(selected.begin(), selected.end(), heapCompare);
+            selected.pop_back();
+        }
+        selected.emplace_back(best[i], i);
+        std::push_heap(selected.begin(), selected.end(), heapCompare);
+    }
+
+    candidates.clear();
+    candidates.boxes.reserve(selected.size());
+    candidates.confs.reserve(selected.size());
+    candidates.classIds.reserve(selected.size());
+    if (nm > 0)
+        candidates.proposals.reserve(selected.size());
+    for (const auto &candidate : selected)
+    {
+        int i = candidate.second;
+        if (nm > 0)
+        {
+            std::vector<float> coeffs(nm);
+            const float *maskPlanes = output + (4 + nc) * na + i;
+            for (int j = 0; j < nm; j++)
+                coeffs[j] = maskPlanes[j * na];
+            candidates.proposals.push_back(std::move(coeffs));
+        }
+        int centerX = (int)(output[i]);
+        int centerY = (int)(output[na + i]);
+        int width = (int)(output[2 * na + i]);
+        int height = (int)(output[3 * na + i]);
+        candidates.boxes.emplace_back(centerX - width / 2, centerY - height / 2, width, height);
+        candidates.confs.push_back(candidate.first);
+        candidates.classIds.push_back(bestIds[i]);
+    }
+}
+
+// the specialized decoder for a head shape if there is one, otherwise the generic one;
+// other anchor counts (and dynamic ones, <= 0) only specialize the class and mask counts
+HeadDecoder selectHeadDecoder(int classNums, int maskNums, int anchors, const char **name = nullptr);
@@ -0,0 +1,71 @@
+#pragma once
+#include <fstream>
+#include <regex>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+// Job mode for large corpora. The input tree is enumerated once into a manifest of
+// relative paths; processes split it either by a deterministic shard or by claiming
+// chunks from a directory queue; every finished item is appended to a per-worker
+// checkpoint log so a restarted job skips what is already done.
+namespace job
+{
+    // sorted relative paths of files under root matching pattern, read back from
+    // manifestPath when it exists, otherwise enumerated and written there
+    std::vector<std::string> loadOrBuildManifest(const std::string &root, const std::string &manifestPath,
+                                                 const std::regex &pattern);
+
+    // "i/N" with 0 <= i < N
+    bool parseShard(const std::string &spec, int &index, int &count);
+    // assignment by a hash of the item itself, so it does not depend on manifest order
+    bool inShard(const std::string &item, int index, int count);
+
+    // hostname-pid, unique among concurrent workers on a shared filesystem
+    std::string workerId();
+
+    // Append-only log of completed items, one per line. Items completed by any worker
+    // (every *.log in dir) are loaded at construction; new ones go to dir/name.log.
+    class CheckpointLog
+    {
+    public:
+        CheckpointLog(const std::string &dir, const std::string &name);
+
+        bool done(const std::string &item) const;
+        // written and flushed before returning, a crash loses at most the item in flight
+        void markDone(const std::string &item);
+        size_t doneCount() const;
+
+    private:
+        std::unordered_set<std::string> completed;
+        std::ofstream log;
+    };
+
+    // Chunks of the manifest as files under dir/pending. A worker claims one by
+    // renaming it into dir/claimed, which succeeds for exactly one of any racing
+    // workers, and moves it to dir/done once every item in it is finished or requeued.
+    class DirectoryQueue
+    {
+    public:
+        DirectoryQueue(const std::string &dir, const std::string &workerId);
+
+        // splits items into chunks once per queue; the first worker seeds, the others wait for
+        // it and take over when it stops (its process is gone, or it stopped touching the lock)
+        void seed(const std::vector<std::string> &items, size_t chunkSize);
+        // false once nothing is pending
+        bool claim(std::vector<std::string> &items);
+        // refreshes the claim so requeueStale leaves it alone
+        void heartbeat();
+        // retires the claimed chunk; failed items go back to pending as a chunk of their own,
+        // at most maxRetries times, after that to dir/failed
+        void complete(const std::vector<std::string> &failed = std::vector<std::string>(), int maxRetries = 3);
+        // returns claims to pending whose worker ran on this host and is gone, or that have been
+        // idle for longer than maxAgeSeconds (0 disables the age check)
+        int requeueStale(int maxAgeSeconds);
+
+    private:
+        std::string dir;
+        std::string id;
+        std::string claimed;
+    };
+}
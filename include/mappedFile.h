@@ -0,0 +1,27 @@
+#pragma once
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Read-only view of a whole file. On POSIX the file is mmapped, so the bytes come
+// straight from the page cache and several mappings of one file share memory; other
+// platforms read it into a buffer. An empty or missing file gives an empty view.
+class MappedFile
+{
+public:
+    // populate faults every page in up front, so later reads never block on the disk
+    explicit MappedFile(const std::string &path, bool populate = false);
+    ~MappedFile();
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    const char *data() const { return bytes; }
+    size_t size() const { return length; }
+    bool empty() const { return length == 0; }
+
+private:
+    const char *bytes = nullptr;
+    size_t length = 0;
+    bool mapped = false;
+    std::vector<char> buffer;
+};
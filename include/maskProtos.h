@@ -0,0 +1,35 @@
+#pragma once
+#include <memory>
+#include <opencv2/opencv.hpp>
+
+// Prototype masks of one frame, [channels, height, width] floats as the segmentation head
+// returns them, with the letterbox that maps them onto the original image. A detection's
+// mask is sigmoid(coefficients . prototypes) cropped to its box; here it is computed from
+// the prototype cells under the box only and resampled straight to the size asked for, so
+// no full-frame mask is ever built. Lazy results (PredictorOptions::lazyMasks) share one of
+// these per frame and compute their mask only when it is read.
+class MaskProtos
+{
+public:
+    // owner keeps data alive, e.g. the ORT output tensors; leave it null for a view that
+    // is only used while data is known to be valid
+    MaskProtos(const float *data, int channels, int height, int width,
+               const cv::Size &inputShape, const cv::Size &originalShape, float threshold,
+               std::shared_ptr<const void> owner = nullptr);
+
+    // mask of box (original image coordinates) resampled to size, 0 or 255;
+    // size equal to the box size gives what eager postprocessing puts in boxMask
+    cv::Mat boxMask(const float *coeffs, const cv::Rect &box, const cv::Size &size) const;
+    const cv::Size &imageShape() const { return originalShape; }
+    size_t bytes() const { return (size_t)channels * height * width * sizeof(float); }
+
+private:
+    const float *data;
+    int channels, height, width;
+    cv::Size inputShape;
+    cv::Size originalShape;
+    float threshold;
+    std::shared_ptr<const void> owner;
+    // original image -> prototype cells
+    float scaleX, scaleY, offsetX, offsetY;
+};
@@ -0,0 +1,83 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <string>
+
+// Process-wide metrics. Every thread records into its own shard with relaxed stores (no
+// locked instructions, no cache lines shared with other writers); shards are only summed
+// when a scrape or snapshot asks for them.
+namespace metrics
+{
+    enum Counter
+    {
+        FRAMES,
+        REQUESTS,
+        DETECTIONS,
+        CACHE_HITS,
+        CACHE_MISSES,
+        ERRORS,
+        // bytes held by returned results (masks, outlines), over DETECTIONS gives bytes per result
+        RESULT_BYTES,
+        COUNTER_COUNT
+    };
+
+    enum Stage
+    {
+        STAGE_DECODE,
+        STAGE_PREPROCESS,
+        STAGE_INFERENCE,
+        STAGE_POSTPROCESS,
+        STAGE_TOTAL,
+        STAGE_COUNT
+    };
+
+    enum Gauge
+    {
+        QUEUE_DEPTH,
+        GAUGE_COUNT
+    };
+
+    void add(Counter counter, uint64_t n = 1);
+    void observe(Stage stage, double ms);
+    void observeDetections(size_t detections);
+    // evaluated at scrape time, e.g. a queue's size()
+    void setGaugeSource(Gauge gauge, std::function<int64_t()> source);
+
+    // Prometheus text exposition format
+    std::string prometheusText();
+    // one line of rates and mean latencies since the previous snapshot
+    std::string snapshotLine();
+
+    // serves prometheusText() on http://127.0.0.1:port/metrics from a background thread (POSIX only)
+    bool serveHttp(int port);
+    // prints snapshotLine() every intervalSeconds from a background thread
+    void startReporter(int intervalSeconds);
+
+    // resident set size of this process, 0 where unknown
+    size_t residentBytes();
+    // high-water mark of residentBytes() over the process lifetime (VmHWM), 0 where unknown
+    size_t peakResidentBytes();
+    // sample residentBytes() whenever a stage is observed and keep the largest value per stage;
+    // costs a /proc read per observation, so it is off by default
+    void trackMemory(bool enable);
+    // largest resident size seen at the end of the stage, 0 unless trackMemory is on
+    size_t stagePeakResidentBytes(Stage stage);
+    // peak resident size, per-stage peaks and bytes per result
+    std::string memoryLine();
+
+    // records the lifetime of the scope into a stage
+    class ScopedTimer
+    {
+    public:
+        explicit ScopedTimer(Stage stage) : stage(stage), start(std::chrono::steady_clock::now()) {}
+        ~ScopedTimer()
+        {
+            observe(stage, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+        }
+
+    private:
+        Stage stage;
+        std::chrono::steady_clock::time_point start;
+    };
+}
@@ -0,0 +1,85 @@
+#pragma once
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <onnxruntime_cxx_api.h>
+
+#include "yolov8Predictor.h"
+#include "cascade.h"
+
+// Several models in one process under a single Ort::Env with global thread pools,
+// so running a detector and a segmenter side by side does not oversubscribe cores.
+// Sessions also share one pre-packed weights container, so a model added twice (e.g. with
+// different class filters) keeps its pre-packed weights once.
+class ModelRegistry
+{
+public:
+    // 0 threads lets ORT pick (one intra-op thread per physical core);
+    // intraOpCpus pins one intra-op thread to each cpu and overrides intraOpThreads
+    explicit ModelRegistry(int intraOpThreads = 0, int interOpThreads = 0,
+                           const std::vector<int> &intraOpCpus = std::vector<int>());
+
+    YOLOPredictor &add(const std::string &name,
+                       const std::string &modelPath,
+                       const bool &isGPU,
+                       float confThreshold,
+                       float iouThreshold,
+                       float maskThreshold,
+                       PredictorOptions options = PredictorOptions());
+    YOLOPredictor &get(const std::string &name);
+
+    // cascade mode: the screener runs first on every frame and the models added above only on
+    // frames, or regions, where it finds candidates (see cascade.h). Its confidence threshold
+    // is cascadeOptions.screenConf; it shares preprocessing with a model of the same input config.
+    YOLOPredictor &setScreener(const std::string &modelPath,
+                               const bool &isGPU,
+                               const cascade::Options &cascadeOptions,
+                               PredictorOptions options = PredictorOptions());
+    bool hasScreener() const { return screener != nullptr; }
+    // a consistent snapshot, safe to take while infer workers are screening
+    cascade::Stats cascadeStats() const;
+    const std::vector<std::string> &modelNames() const { return names; }
+
+    // run every model on the same frame, results follow modelNames();
+    // models with the same input config share one letterboxed tensor,
+    // models with a result cache skip frames they have already seen, unless useCache is false
+    // because the caller caches the frame under its own key (see lookupAll);
+    // with a screener, frames it rejects get empty results from every model
+    std::vector<std::vector<Yolov8Result>> predictAll(cv::Mat &image, bool useCache = true);
+
+    // every model on several frames, results[frame][model]; each model runs the frames as
+    // one batch when it can (see YOLOPredictor::predictBatch), the result cache is not used
+    std::vector<std::vector<std::vector<Yolov8Result>>> predictAllBatch(std::vector<cv::Mat> &images);
+
+    // cached results of every model for contentHash (e.g. a hash of the file bytes),
+    // false if any model misses; counts as one hit, saving inputBytes, only when all hit.
+    // Keys include the screener and its settings, whose rejections are cached too.
+    bool lookupAll(uint64_t contentHash, std::vector<std::vector<Yolov8Result>> &results, size_t inputBytes);
+    void storeAll(uint64_t contentHash, const std::vector<std::vector<Yolov8Result>> &results, size_t inputBytes);
+
+private:
+    std::shared_ptr<Ort::Env> env;
+    std::shared_ptr<Ort::PrepackedWeightsContainer> prepackedWeights;
+    std::vector<std::string> names;
+    std::vector<std::unique_ptr<YOLOPredictor>> predictors;
+    std::vector<PredictorOptions> options;
+    // index of the first predictor with the same preprocessing
+    std::vector<size_t> inputSource;
+
+    std::unique_ptr<YOLOPredictor> screener;
+    cascade::Options screenOptions;
+    // updated by every infer worker that screens a frame
+    cascade::Stats screenStats;
+    mutable std::mutex screenMutex;
+    // screener identity and settings, mixed into the keys of lookupAll and storeAll
+    uint64_t screenHash = 0;
+
+    uint64_t cascadeKey(uint64_t contentHash) const;
+
+    // screener pass of predictAll: the region the models run on, and its tensor when a
+    // model can reuse it
+    cv::Rect screen(cv::Mat &image, std::vector<LetterboxedInput> &inputs, std::vector<bool> &prepared);
+    void predictRegion(cv::Mat &image, std::vector<LetterboxedInput> &inputs, std::vector<bool> &prepared,
+                       std::vector<std::vector<Yolov8Result>> &results, bool useCache = true);
+};
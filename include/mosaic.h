@@ -0,0 +1,34 @@
+#pragma once
+#include <cstddef>
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+#include "utils.h"
+
+// Packs small images (thumbnails, crops) side by side onto model-sized canvases, so one
+// inference covers many of them instead of letterboxing each up to the input size.
+// Images are placed at their own scale; a gutter of padding between them keeps objects
+// near an edge from being merged with the neighbouring image.
+namespace mosaic
+{
+    struct Tile
+    {
+        size_t source;   // index into the packed images
+        cv::Rect region; // where the image sits on the canvas
+    };
+
+    struct Mosaic
+    {
+        cv::Mat canvas;
+        std::vector<Tile> tiles;
+    };
+
+    // shelf packing, tallest images first, each shelf filled left to right and every canvas
+    // tried before a new one is opened; throws if an image is larger than the canvas
+    std::vector<Mosaic> pack(const std::vector<cv::Mat> &images, const cv::Size &canvasSize, int gutter = 16);
+
+    // detections on a mosaic, one list per tile in tile order: each detection goes to the
+    // tile containing its center, clipped to it and moved to source image coordinates;
+    // detections centered in a gutter are dropped
+    std::vector<std::vector<Yolov8Result>> split(const Mosaic &mosaic, const std::vector<Yolov8Result> &results);
+}
@@ -0,0 +1,90 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+#include "boundedQueue.h"
+#include "utils.h"
+
+struct StageConfig
+{
+    int workers = 1;
+    // cpus the stage's workers are pinned to, empty leaves them to the scheduler
+    std::vector<int> cpus;
+};
+
+struct PipelineConfig
+{
+    StageConfig decode;
+    StageConfig infer;
+    StageConfig encode;
+    // frames waiting between two stages, bounds the frames in flight
+    size_t queueSize = 8;
+    // at most this many frames (decoded images, results) between submit and the end of the
+    // encode stage, 0 leaves the bound to the queues; submit blocks at the limit
+    size_t maxInFlight = 0;
+};
+
+// one item moving through the stages
+struct PipelineFrame
+{
+    std::string path;
+    cv::Mat image;
+    std::vector<std::vector<Yolov8Result>> results;
+    // with a result cache: hash and size of the file bytes, and whether results came from it
+    uint64_t fileHash = 0;
+    size_t fileBytes = 0;
+    bool cached = false;
+};
+
+// Decode, infer and encode stages with their own workers, connected by bounded queues.
+// Each worker pins itself before its first frame, so the buffers a stage allocates and
+// fills are placed on the node of the cpus it runs on.
+class Pipeline
+{
+public:
+    // decode returns false to drop a frame (e.g. an unreadable file)
+    typedef std::function<bool(PipelineFrame &)> DecodeFn;
+    typedef std::function<void(PipelineFrame &)> StageFn;
+
+    Pipeline(const PipelineConfig &config, DecodeFn decode, StageFn infer, StageFn encode);
+    ~Pipeline();
+    Pipeline(const Pipeline &) = delete;
+    Pipeline &operator=(const Pipeline &) = delete;
+
+    // blocks while the decode queue is full or maxInFlight frames are in flight
+    void submit(PipelineFrame frame);
+    // no more frames; returns once every submitted frame has left the encode stage
+    void finish();
+    size_t completed() const { return completedFrames; }
+    // frames submitted and not yet completed or dropped
+    size_t inFlight() const { return submittedFrames - completedFrames - droppedFrames; }
+
+private:
+    typedef std::unique_ptr<PipelineFrame> FramePtr;
+
+    PipelineConfig config;
+    DecodeFn decode;
+    StageFn infer;
+    StageFn encode;
+    BoundedQueue<FramePtr> decodeQueue;
+    BoundedQueue<FramePtr> inferQueue;
+    BoundedQueue<FramePtr> encodeQueue;
+    std::vector<std::thread> decodeWorkers, inferWorkers, encodeWorkers;
+    std::atomic<size_t> submittedFrames{0};
+    std::atomic<size_t> completedFrames{0};
+    std::atomic<size_t> droppedFrames{0};
+    bool finished = false;
+    // submit waits here for a frame to leave when maxInFlight is set
+    std::mutex slotMutex;
+    std::condition_variable slotFreed;
+
+    void runStage(const StageConfig &stage, BoundedQueue<FramePtr> &input, BoundedQueue<FramePtr> *output,
+                  const DecodeFn &work);
+};
@@ -0,0 +1,54 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Wire format between yolov8_serve and its clients over a Unix domain socket.
+// A connection carries any number of request/response pairs, one at a time:
+//   request:  RequestHeader + payloadSize bytes of an encoded image (jpg/png)
+//   response: ResponseHeader + count Detection records
+namespace protocol
+{
+    const uint32_t MAGIC = 0x59384F52;
+    const uint32_t MAX_PAYLOAD = 64u << 20;
+
+    enum Status : int32_t
+    {
+        OK = 0,
+        BUSY = 1,        // shed at admission, the request queue was full
+        TIMEOUT = 2,     // the deadline passed before a worker picked it up
+        BAD_REQUEST = 3, // payload could not be decoded or inference failed
+    };
+
+    struct RequestHeader
+    {
+        uint32_t magic;
+        uint32_t deadlineMs; // 0 uses the server default
+        uint32_t payloadSize;
+    };
+
+    struct ResponseHeader
+    {
+        uint32_t magic;
+        int32_t status;
+        uint32_t count;
+        float queueMs;
+        float inferMs;
+    };
+
+    struct Detection
+    {
+        int32_t x, y, width, height;
+        float conf;
+        int32_t classId;
+    };
+
+    const char *statusName(int32_t status);
+
+    // return a socket fd, or -1 with the reason printed to stderr
+    int listenUnix(const std::string &path, int backlog);
+    int connectUnix(const std::string &path);
+
+    bool sendAll(int fd, const void *data, size_t size);
+    bool recvAll(int fd, void *data, size_t size);
+}
@@ -0,0 +1,68 @@
+#pragma once
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+#include "utils.h"
+
+// Results keyed by a content hash (decoded pixels or raw file bytes, combined with the
+// model identity and thresholds by the predictor). An in-memory LRU tier is bounded by
+// memoryBudget bytes; the optional on-disk tier keeps one file per key, read back
+// through mmap, and is bounded by diskBudget bytes. Thread-safe.
+class ResultCache
+{
+public:
+    struct Stats
+    {
+        uint64_t hits = 0;
+        uint64_t diskHits = 0;
+        uint64_t misses = 0;
+        uint64_t evictions = 0;
+        // input bytes whose preprocessing and inference were skipped
+        uint64_t bytesSaved = 0;
+        size_t memoryBytes = 0;
+        size_t entries = 0;
+    };
+
+    explicit ResultCache(size_t memoryBudget, const std::string &diskDir = "", size_t diskBudget = 0);
+
+    // count false leaves the hit and miss counters alone, for callers that combine
+    // several lookups into one and record it with countLookup
+    bool get(uint64_t key, std::vector<Yolov8Result> &results, bool count = true);
+    void countLookup(bool hit, size_t inputBytes);
+    // inputBytes is what a later hit saves (pixel or file bytes)
+    void put(uint64_t key, const std::vector<Yolov8Result> &results, size_t inputBytes);
+    Stats stats() const;
+
+    // hash of the pixels plus size and type, so differently shaped frames never collide
+    static uint64_t hashImage(const cv::Mat &image);
+
+private:
+    struct Entry
+    {
+        uint64_t key;
+        std::vector<Yolov8Result> results;
+        size_t inputBytes;
+        size_t bytes;
+    };
+
+    size_t memoryBudget;
+    std::string diskDir;
+    size_t diskBudget;
+    size_t diskBytes = 0;
+
+    // most recently used first
+    std::list<Entry> lru;
+    std::unordered_map<uint64_t, std::list<Entry>::iterator> index;
+    Stats counters;
+    mutable std::mutex mutex;
+
+    void insert(Entry entry);
+    std::string diskPath(uint64_t key) const;
+    bool readDisk(uint64_t key, Entry &entry);
+    void writeDisk(const Entry &entry);
+};
@@ -0,0 +1,29 @@
+#pragma once
+#include <memory>
+#include <string>
+#include <vector>
+#include <onnxruntime_cxx_api.h>
+
+#include "mappedFile.h"
+
+// Initializers split out of a model by tools/split_weights.py. The weights file is mapped
+// once and every session created with addTo() uses the tensors in place, so N sessions of
+// the model hold one copy of the weights instead of N. Must outlive those sessions.
+class SharedWeights
+{
+public:
+    // reads weightsPath and its index weightsPath + ".idx"
+    explicit SharedWeights(const std::string &weightsPath);
+    SharedWeights(const SharedWeights &) = delete;
+    SharedWeights &operator=(const SharedWeights &) = delete;
+
+    void addTo(Ort::SessionOptions &sessionOptions) const;
+    size_t count() const { return names.size(); }
+    size_t bytes() const { return totalBytes; }
+
+private:
+    std::unique_ptr<MappedFile> file;
+    std::vector<std::string> names;
+    std::vector<Ort::Value> values;
+    size_t totalBytes = 0;
+};
@@ -0,0 +1,48 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <opencv2/opencv.hpp>
+
+// Single-producer/single-consumer ring of raw BGR frames in POSIX shared memory.
+// The producer writes straight into a slot and publishes it; the consumer wraps the
+// slot in a cv::Mat header (no copy) and releases it when done. Both sides block on
+// futexes living in the shared header, so an idle ring costs no CPU. Linux only.
+class ShmFrameRing
+{
+public:
+    // create (producer) a ring of slots frames up to maxSize, or open (consumer) an existing one
+    ShmFrameRing(const std::string &name, int slots, const cv::Size &maxSize);
+    explicit ShmFrameRing(const std::string &name);
+    ~ShmFrameRing();
+    ShmFrameRing(const ShmFrameRing &) = delete;
+    ShmFrameRing &operator=(const ShmFrameRing &) = delete;
+
+    // producer: a header over the next free slot, empty on timeout or when size exceeds the slot
+    cv::Mat acquireWrite(const cv::Size &size, int timeoutMs = -1);
+    void publish();
+    // producer: no more frames, wakes a waiting consumer
+    void close();
+
+    // consumer: the oldest published frame, valid until release(); false on timeout or once closed and drained
+    bool acquireRead(cv::Mat &frame, uint64_t &frameId, int timeoutMs = -1);
+    void release();
+
+    int slotCount() const;
+    // published frames not yet released by the consumer
+    int pending() const;
+    cv::Size maxFrameSize() const;
+
+private:
+    struct Header;
+    struct SlotHeader;
+
+    std::string name;
+    bool owner = false;
+    void *mapping = nullptr;
+    size_t mappingSize = 0;
+    Header *header = nullptr;
+
+    SlotHeader *slot(uint32_t sequence) const;
+    void map(int fd, size_t size);
+};
@@ -0,0 +1,29 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+#include "yolov8Predictor.h"
+
+// Runtime configuration picked by yolov8_tune for one model on one machine type.
+// Stored as key=value lines; '#' starts a comment and unknown keys are ignored, so a
+// profile can be edited by hand.
+struct TuneProfile
+{
+    int threads = 0;           // intra-op threads, 0 lets ORT decide
+    int batch = 1;             // frames per session run
+    std::vector<int> pipeline; // decode, infer, encode workers; empty runs frames one by one
+    cv::Size inputSize;        // letterbox size of dynamic-shape models, empty keeps the default
+
+    // what the tuner measured with this configuration, informational
+    double fps = 0.0;
+    double p50Ms = 0.0;
+    double p95Ms = 0.0;
+
+    // throws std::runtime_error if the file cannot be read or a value does not parse
+    static TuneProfile load(const std::string &path);
+    void save(const std::string &path, const std::string &comment = "") const;
+
+    // threads, input size and a warmup of the batch size
+    void applyTo(PredictorOptions &options) const;
+};
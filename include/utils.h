@@ -1,25 +1,48 @@
 #pragma once
 #include <codecvt>
 #include <fstream>
+#include <memory>
+#include <sstream>
 #include <opencv2/opencv.hpp>
 
+class MaskProtos;
+
 struct Yolov8Result
 {
     cv::Rect box;
     cv::Mat boxMask; // mask in box
+    // outlines of boxMask in image coordinates, filled only when PredictorOptions::contours is set
+    std::vector<std::vector<cv::Point>> contours;
     float conf{};
     int classId{};
+    // lazy masks (PredictorOptions::lazyMasks): boxMask stays empty and the mask is computed
+    // from these coefficients and the frame's prototypes when mask() or imageMask() asks
+    std::vector<float> maskCoeffs;
+    std::shared_ptr<const MaskProtos> protos;
+
+    // box-local mask at scale times the box size, empty for detection models and for boxes
+    // that round to nothing at this scale
+    cv::Mat mask(double scale = 1.0) const;
+    // the mask placed in an image of imageShape times scale, zero outside the box
+    cv::Mat imageMask(const cv::Size &imageShape, double scale = 1.0) const;
+    // computes boxMask of a lazy result and drops its reference to the prototypes
+    void materialize();
 };
 
 namespace utils
 {
-    static std::vector<cv::Scalar> colors;
-
     size_t vectorProduct(const std::vector<int64_t> &vector);
+    // 64-bit xxHash of a byte range, seed chains several ranges together
+    uint64_t hashBytes(const void *data, size_t size, uint64_t seed = 0);
     std::wstring charToWstring(const char *str);
     std::vector<std::string> loadNames(const std::string &path);
+    // fixed per-class palette, the same colors in every run and translation unit
+    const cv::Scalar &classColor(int classId, bool forMask = false);
     void visualizeDetection(cv::Mat &image, std::vector<Yolov8Result> &results,
                             const std::vector<std::string> &classNames);
+    // draws in place and blends only inside boxes and labels; scratch is reused between calls
+    void visualizeDetection(cv::Mat &image, const std::vector<Yolov8Result> &results,
+                            const std::vector<std::string> &classNames, cv::Mat &scratch);
 
     void letterbox(const cv::Mat &image, cv::Mat &outImage,
                    const cv::Size &newShape,
@@ -32,6 +55,37 @@ namespace utils
     void scaleCoords(cv::Rect &coords, cv::Mat &mask,
                      const float maskThreshold,
                      const cv::Size &imageShape, const cv::Size &imageOriginalShape);
+    // the box part of scaleCoords, letterbox to original image coordinates
+    void scaleBox(cv::Rect &coords, const cv::Size &imageShape, const cv::Size &imageOriginalShape);
+    // letterbox gain and the padding on the left and top, as scaleCoords computes them
+    float letterboxGain(const cv::Size &imageShape, const cv::Size &imageOriginalShape, cv::Point &pad);
+    // memory held by results: the structs, their masks and outlines
+    size_t resultBytes(const std::vector<Yolov8Result> &results);
+
+    // shapes with one side equal to maxShape and the other a multiple of step
+    std::vector<cv::Size> makeShapeBuckets(const cv::Size &maxShape, int step);
+    // smallest bucket covering shape that keeps one of its sides, so the letterbox gain is unchanged
+    bool selectShapeBucket(const cv::Size &shape, const std::vector<cv::Size> &buckets, cv::Size &bucket);
+
+    // "a,b,,c" -> {"a", "b", "c"}
+    std::vector<std::string> split(const std::string &str, char delimiter);
+    // "640x640,640x384" -> {640x640, 640x384}
+    std::vector<cv::Size> parseShapes(const std::string &str);
+    // "1,2,4" -> {1, 2, 4}
+    std::vector<int> parseInts(const std::string &str);
+    // prints model parse and session initialization times from an ORT profile json, then removes it
+    void printStartupProfile(const std::string &profilePath);
+
+    // "0-3,8" -> {0, 1, 2, 3, 8}, the format of Linux cpulist files
+    std::vector<int> parseCpuList(const std::string &str);
+    // cpus of a NUMA node, empty where unknown
+    std::vector<int> numaNodeCpus(int node);
+    // restricts the calling thread to cpus (Linux only); memory it touches first is then
+    // placed on their node by the default first-touch policy
+    bool pinThread(const std::vector<int> &cpus);
+    // ORT intra-op affinity pinning one thread to each cpu, "c1;c2;..."; the first cpu is
+    // left to the thread calling Run, which ORT does not pin
+    std::string ortAffinity(const std::vector<int> &cpus);
 
     template <typename T>
     T clip(const T &n, const T &lower, const T &upper);
@@ -0,0 +1,50 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Thread pool with one task deque per worker. A worker runs its own tasks newest first
+// and, when it runs dry, steals the oldest task of another worker, so short bursts of
+// fine-grained work (e.g. finalizing the detections of one frame) spread over whatever
+// threads are idle. One pool can be shared by several predictors. Pipeline stages keep
+// their own threads: they block on their queues and pin to their own cpus.
+class WorkStealingPool
+{
+public:
+    // cpus pins worker i to cpus[i % cpus.size()], empty leaves them to the scheduler
+    explicit WorkStealingPool(int threads, const std::vector<int> &cpus = std::vector<int>());
+    ~WorkStealingPool();
+    WorkStealingPool(const WorkStealingPool &) = delete;
+    WorkStealingPool &operator=(const WorkStealingPool &) = delete;
+
+    // from a worker the task goes to that worker's deque, otherwise round robin
+    void submit(std::function<void()> task);
+    // runs fn(0) .. fn(count - 1) on the pool and the calling thread and returns once all
+    // have finished; safe to call from a pool task. The first exception thrown is rethrown.
+    void parallelFor(size_t count, const std::function<void(size_t)> &fn);
+    int size() const { return (int)workers.size(); }
+
+private:
+    struct TaskDeque
+    {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    std::vector<std::unique_ptr<TaskDeque>> deques;
+    std::vector<std::thread> workers;
+    std::atomic<size_t> nextDeque{0};
+    std::atomic<size_t> queued{0};
+    std::mutex sleepMutex;
+    std::condition_variable wake;
+    bool stopping = false;
+
+    void run(size_t index, const std::vector<int> &cpus);
+    bool popTask(size_t index, std::function<void()> &task);
+};
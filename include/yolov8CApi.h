@@ -0,0 +1,94 @@
+#pragma once
+/*
+ * C interface to the yolov8 library for embedding in other services.
+ * Only plain C types cross the boundary: the caller owns the BGR pixels and the result
+ * arrays, and nothing is allocated per call on the caller's side. A predictor handle must
+ * not be used from two threads at once; separate handles are independent.
+ * Functions that fail return NULL or a negative value and set yolov8_last_error().
+ */
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(_WIN32) && defined(YOLOV8_SHARED)
+#ifdef YOLOV8_BUILDING
+#define YOLOV8_API __declspec(dllexport)
+#else
+#define YOLOV8_API __declspec(dllimport)
+#endif
+#elif defined(__GNUC__)
+#define YOLOV8_API __attribute__((visibility("default")))
+#else
+#define YOLOV8_API
+#endif
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    typedef struct yolov8_predictor yolov8_predictor;
+
+    /* box in original image pixels */
+    typedef struct yolov8_detection
+    {
+        int32_t x;
+        int32_t y;
+        int32_t width;
+        int32_t height;
+        float conf;
+        int32_t class_id;
+    } yolov8_detection;
+
+    typedef struct yolov8_config
+    {
+        int use_gpu;
+        float conf_threshold;
+        float iou_threshold;
+        float mask_threshold;
+        /* intra-op threads of this handle's own pool, 0 lets ORT decide */
+        int intra_op_threads;
+        /* keep at most this many candidates before NMS, 0 keeps all */
+        int top_k;
+        int warmup;
+    } yolov8_config;
+
+    /* defaults matching the CLI: conf 0.4, iou 0.4, mask 0.5, warmup on */
+    YOLOV8_API void yolov8_default_config(yolov8_config *config);
+
+    YOLOV8_API yolov8_predictor *yolov8_create(const char *model_path, const yolov8_config *config);
+    YOLOV8_API void yolov8_destroy(yolov8_predictor *predictor);
+
+    YOLOV8_API int yolov8_class_count(const yolov8_predictor *predictor);
+    YOLOV8_API int yolov8_has_masks(const yolov8_predictor *predictor);
+
+    /*
+     * Detect on a width x height 8-bit BGR image whose rows are stride bytes apart.
+     * Up to capacity detections are written to detections, highest confidence first.
+     * Returns the total number of detections, which may exceed capacity, or -1 on error.
+     */
+    YOLOV8_API int yolov8_detect(yolov8_predictor *predictor,
+                                 const uint8_t *bgr, int width, int height, size_t stride,
+                                 yolov8_detection *detections, int capacity);
+
+    /*
+     * Segmentation models: copies the box-sized mask (width * height bytes, 0 or 255) of
+     * detection index from the last yolov8_detect call. Returns the bytes needed, or -1;
+     * 0 for a box with no area. Nothing is copied when capacity is smaller than that.
+     */
+    YOLOV8_API long yolov8_mask(const yolov8_predictor *predictor, int index, uint8_t *mask, size_t capacity);
+
+    /*
+     * Like yolov8_mask, at scale (0 < scale <= 1) times the box size, or over the whole image
+     * when full_image is set (zero outside the box). width and height, when not null, receive
+     * the mask size. Masks are computed on request, so detections whose mask is never read
+     * cost no mask work.
+     */
+    YOLOV8_API long yolov8_mask_at(const yolov8_predictor *predictor, int index, int full_image, double scale,
+                                   uint8_t *mask, size_t capacity, int *width, int *height);
+
+    /* message of the last failure on the calling thread, empty if none */
+    YOLOV8_API const char *yolov8_last_error(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -1,9 +1,110 @@
 #pragma once
 #include <opencv2/opencv.hpp>
 #include <onnxruntime_cxx_api.h>
+#include <memory>
 #include <utility>
 
 #include "utils.h"
+#include "maskProtos.h"
+#include "resultCache.h"
+#include "headDecoder.h"
+#include "mappedFile.h"
+#include "sharedWeights.h"
+#include "workPool.h"
+
+struct PredictorOptions
+{
+    // tuning profile written by yolov8_tune, its values replace the matching options
+    std::string profilePath;
+
+    // share one Env between predictors; null creates a private Env
+    std::shared_ptr<Ort::Env> env;
+    // the shared Env was created with global thread pools, so sessions must not spawn their own
+    bool globalThreadPool = false;
+    // per-session pools only: one intra-op thread pinned to each of these cpus
+    std::vector<int> intraOpCpus;
+    // per-session pools only: intra-op threads when no cpus are given, 0 lets ORT decide
+    int intraOpThreads = 0;
+
+    // dynamic-shape models only: letterbox target, e.g. 640x384 for 16:9 cameras (empty keeps 640x640)
+    cv::Size inputSize;
+
+    // build the session from an mmapped model instead of letting ORT read the file;
+    // .ort models are always mapped and their weights used in place, without a copy
+    bool mmapModel = false;
+    // save the optimized graph here; loading it later skips graph optimization
+    std::string optimizedModelPath;
+    // split session creation into parse and initialize times using ORT's profiler
+    bool profileStartup = false;
+
+    // several sessions of one model: pre-packed (layout transformed) weights are kept once
+    // in this container instead of once per session
+    std::shared_ptr<Ort::PrepackedWeightsContainer> prepackedWeights;
+    // initializers mapped once from tools/split_weights.py output and used in place by
+    // every session given the same object; the model must be the matching split model
+    std::shared_ptr<SharedWeights> sharedWeights;
+
+    // cap ORT's memory arena at this many bytes, 0 leaves it unbounded. On CPU the capped
+    // arena is registered on the Env (see YOLOPredictor::registerArena) and shared by its
+    // sessions; the first cap registered in the process applies to every session
+    size_t arenaMaxBytes = 0;
+    // grow the arena by what a request needs instead of the next power of two
+    bool arenaExtendSameAsRequested = false;
+
+    // compute each mask from the prototype cells under its box and upsample only the box,
+    // instead of a full-frame float mask per detection; boundaries may differ by a pixel
+    bool cropMasks = false;
+    // segmentation results keep their mask coefficients and a shared handle to the frame's
+    // prototypes instead of a mask; Yolov8Result::mask() computes it when asked, at the size
+    // asked for. Each frame's output tensors live as long as one of its results does.
+    // Ignored with contours, which need every mask.
+    bool lazyMasks = false;
+    // process memory budget in bytes: masks are cropped as above while the resident size is
+    // over 3/4 of it (0 disables); always, when results are cached
+    size_t memoryBudget = 0;
+
+    // run warmup() at construction so the first predict hits warmed arenas and kernels
+    bool warmup = true;
+    // WxH shapes to warm; empty means the model input shape (or every bucket)
+    std::vector<cv::Size> warmupShapes;
+    std::vector<int> warmupBatchSizes{1};
+
+    // dynamic-shape models only: letterboxed inputs are padded up to the smallest bucket
+    // that fits, so every request reuses an already warmed shape
+    std::vector<cv::Size> shapeBuckets;
+    // generate buckets as multiples of bucketStep up to the input size (0 disables)
+    int bucketStep = 0;
+
+    // class ids to decode, empty decodes all; other class planes are never read
+    std::vector<int> classes;
+    // keep at most topK candidates (highest confidence) before NMS, 0 keeps all
+    int topK = 0;
+    // keep at most maxPerClass detections of each class after NMS, 0 keeps all
+    int maxPerClass = 0;
+
+    // detections kept after NMS are finalized (box rescale, mask upsample and threshold,
+    // contours) on this pool, with the calling thread helping; null finalizes them serially
+    std::shared_ptr<WorkStealingPool> finalizePool;
+    // extract the outline of every mask into Yolov8Result::contours
+    bool contours = false;
+
+    // predict(cv::Mat &) answers repeated frames from here without preprocessing or inference
+    std::shared_ptr<ResultCache> resultCache;
+};
+
+// letterboxed CHW float tensor of one frame, reusable by every model with the same input config
+struct LetterboxedInput
+{
+    std::vector<float> blob;
+    // models with embedded preprocessing (tools/embed_preprocess.py) take uint8 BGR HWC
+    // pixels instead: letterboxed, or the frame as it is when the graph letterboxes too
+    cv::Mat pixels;
+    // NCHW for blob, NHWC for pixels
+    std::vector<int64_t> shape{1, 3, -1, -1};
+    cv::Size originalShape;
+    // the frame as the model sees it after letterboxing, detections are relative to it
+    cv::Size letterboxShape;
+};
 
 class YOLOPredictor
 {
@@ -13,27 +114,64 @@ public:
                   const bool &isGPU,
                   float confThreshold,
                   float iouThreshold,
-                  float maskThreshold);
+                  float maskThreshold,
+                  const PredictorOptions &options = PredictorOptions());
     // ~YOLOPredictor();
     std::vector<Yolov8Result> predict(cv::Mat &image);
+    void prepare(cv::Mat &image, LetterboxedInput &input);
+    // dynamic-shape models only: letterbox to inputSize for this call instead of the configured size
+    void prepare(cv::Mat &image, LetterboxedInput &input, const cv::Size &inputSize);
+    std::vector<Yolov8Result> predict(cv::Mat &image, const cv::Size &inputSize);
+    bool dynamicInputShape() const { return isDynamicInputShape; }
+    std::vector<Yolov8Result> predict(const LetterboxedInput &input);
+    // raw-head models with a dynamic (or matching) batch dimension run all frames as one
+    // tensor when they letterbox to the same shape; otherwise frames run one by one
+    std::vector<std::vector<Yolov8Result>> predictBatch(std::vector<cv::Mat> &images);
+    bool dynamicBatch() const { return isDynamicBatch; }
+    // true if prepare() would produce the same tensor for both predictors
+    bool sharesPreprocessing(const YOLOPredictor &other) const;
+    // contentHash is ResultCache::hashImage of the frame or a hash of its file bytes;
+    // lookups miss and stores are dropped when no cache is configured; count false leaves
+    // the hit and miss counts to the caller
+    bool lookupCache(uint64_t contentHash, std::vector<Yolov8Result> &results, bool count = true);
+    void storeCache(uint64_t contentHash, const std::vector<Yolov8Result> &results, size_t inputBytes);
+    void warmup(const std::vector<cv::Size> &shapes, const std::vector<int> &batchSizes);
+    bool hasMasks() const { return hasMask; }
+    // registers a CPU arena capped as the options say on env, for the sessions created on it;
+    // the Env is process-wide and takes one registration, later calls keep the first cap
+    static void registerArena(Ort::Env &env, const PredictorOptions &options);
+    // the model takes uint8 BGR HWC frames and converts them itself
+    bool byteInput() const { return isByteInput; }
     int classNums = 80;
 
 private:
-    Ort::Env env{nullptr};
+    std::shared_ptr<Ort::Env> env;
     Ort::SessionOptions sessionOptions{nullptr};
     Ort::Session session{nullptr};
+    // backs the session of a .ort model for its whole lifetime
+    std::shared_ptr<MappedFile> modelBytes;
+    // the session reads its weights from these, they must outlive it
+    std::shared_ptr<Ort::PrepackedWeightsContainer> prepackedWeights;
+    std::shared_ptr<SharedWeights> sharedWeights;
 
-    void preprocessing(cv::Mat &image, float *&blob, std::vector<int64_t> &inputTensorShape);
+    cv::Mat letterboxFrame(cv::Mat &image, const cv::Size &targetSize);
+    void preprocessing(cv::Mat &image, LetterboxedInput &input, const cv::Size &targetSize);
     std::vector<Yolov8Result> postprocessing(const cv::Size &resizedImageShape,
                                              const cv::Size &originalImageShape,
-                                             std::vector<Ort::Value> &outputTensors);
+                                             std::vector<Ort::Value> &outputTensors,
+                                             size_t batchIndex = 0,
+                                             std::shared_ptr<const void> outputOwner = nullptr);
 
-    static void getBestClassInfo(std::vector<float>::iterator it,
-                                 float &bestConf,
-                                 int &bestClassId,
-                                 const int _classNums);
-    cv::Mat getMask(const cv::Mat &maskProposals, const cv::Mat &maskProtos);
+    cv::Mat getMask(const cv::Mat &maskProposals, const cv::Mat &maskProtos, const cv::Size &inputShape);
+    void findContours(Yolov8Result &result) const;
     bool isDynamicInputShape{};
+    bool isDynamicBatch{};
+    bool isByteInput = false;
+    // set when the graph letterboxes raw frames to this size itself
+    cv::Size embeddedLetterbox;
+    // letterbox target, the model input size or 640x640 for dynamic-shape models
+    cv::Size inputSize{640, 640};
+    std::vector<cv::Size> shapeBuckets;
 
     std::vector<const char *> inputNames;
     std::vector<Ort::AllocatedStringPtr> input_names_ptr;
@@ -47,5 +185,23 @@ private:
     float iouThreshold = 0.4f;
 
     bool hasMask = false;
+    int maskNums = 32;
+    bool hasEmbeddedNms = false;
+    // raw-head decoder chosen once for the head shape, see headDecoder.h
+    HeadDecoder headDecoder = decodeHead<0, 0, 0>;
+
+    std::vector<bool> classAllowed;
+    std::vector<int> decodeClasses;
+    int topK = 0;
+    int maxPerClass = 0;
     float maskThreshold = 0.5f;
+    std::shared_ptr<WorkStealingPool> finalizePool;
+    bool contours = false;
+    bool cropMasks = false;
+    bool lazyMasks = false;
+    size_t memoryBudget = 0;
+
+    std::shared_ptr<ResultCache> resultCache;
+    // model identity and every setting that changes results, mixed into cache keys
+    uint64_t configHash = 0;
 };
\ No newline at end of file
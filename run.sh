@@ -1,3 +1 @@
-./build/yolov8_ort -m ./models/yolov8m.onnx -i ./Imginput -o ./Imgoutput -c ./models/coco.names -x m --gpu
-./build/yolov8_ort -m ./models/yolov8m-seg.onnx -i ./Imginput -o ./Imgoutput -c ./models/coco.names -x ms --gpu
-
+./build/yolov8_ort --models m:./models/yolov8m.onnx,ms:./models/yolov8m-seg.onnx -i ./Imginput -o ./Imgoutput -c ./models/coco.names --gpu
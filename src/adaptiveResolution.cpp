@@ -0,0 +1,91 @@
+#include "adaptiveResolution.h"
+
+#include <algorithm>
+
+ResolutionController::ResolutionController(std::vector<cv::Size> sizes, double sloMs, int workers)
+    : candidates(std::move(sizes)), sloMs(sloMs), workers(std::max(1, workers))
+{
+    if (candidates.empty())
+        throw std::invalid_argument("ResolutionController needs at least one size");
+    std::sort(candidates.begin(), candidates.end(), [](const cv::Size &a, const cv::Size &b)
+              { return a.area() < b.area(); });
+    ewma.assign(candidates.size(), 0.0);
+    measured.assign(candidates.size(), false);
+    selected.assign(candidates.size(), 0);
+    // start at the largest size, the first measurements pull it down if needed
+    current = candidates.size() - 1;
+}
+
+size_t ResolutionController::indexOf(const cv::Size &size) const
+{
+    for (size_t i = 0; i < candidates.size(); i++)
+    {
+        if (candidates[i] == size)
+            return i;
+    }
+    return candidates.size();
+}
+
+double ResolutionController::estimate(size_t index) const
+{
+    if (measured[index])
+        return ewma[index];
+    // scale the nearest measured size by pixel count, inference cost is roughly linear in it
+    for (size_t distance = 1; distance < candidates.size(); distance++)
+    {
+        for (size_t other : {index - distance, index + distance})
+        {
+            if (other < candidates.size() && measured[other])
+                return ewma[other] * candidates[index].area() / candidates[other].area();
+        }
+    }
+    return 0.0;
+}
+
+cv::Size ResolutionController::select(size_t queueDepth)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    double runs = (double)queueDepth / workers + 1.0;
+
+    // step down at once to the largest size whose expected latency fits
+    while (current > 0 && estimate(current) * runs > sloMs)
+        current--;
+    // step up one level only when the larger size fits with headroom
+    if (current + 1 < candidates.size() && estimate(current + 1) * runs < sloMs * upHeadroom)
+        current++;
+
+    selected[current]++;
+    return candidates[current];
+}
+
+void ResolutionController::record(const cv::Size &size, double latencyMs)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    size_t index = indexOf(size);
+    if (index == candidates.size())
+        return;
+    ewma[index] = measured[index] ? alpha * latencyMs + (1.0 - alpha) * ewma[index] : latencyMs;
+    measured[index] = true;
+    for (size_t other = 0; other < candidates.size(); other++)
+    {
+        if (other == index || !measured[other])
+            continue;
+        double scaled = ewma[index] * candidates[other].area() / candidates[index].area();
+        ewma[other] = staleDecay * scaled + (1.0 - staleDecay) * ewma[other];
+    }
+}
+
+std::vector<double> ResolutionController::latencies() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    std::vector<double> values(candidates.size());
+    for (size_t i = 0; i < candidates.size(); i++)
+        values[i] = estimate(i);
+    return values;
+}
+
+std::vector<uint64_t> ResolutionController::counts() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return selected;
+}
@@ -0,0 +1,87 @@
+#include <chrono>
+#include <iostream>
+#include <numeric>
+#include <random>
+#include <vector>
+#include "cmdline.h"
+#include "headDecoder.h"
+
+// Compares the specialized raw-head decoder with the generic one on a synthetic head of
+// the same shape: mostly background scores with a few confident anchors, like a real frame.
+int main(int argc, char *argv[])
+{
+    cmdline::parser cmd;
+    cmd.add<int>("classes", 'c', "Class count of the head.", false, 80);
+    cmd.add<int>("masks", 'm', "Mask coefficients (0 for detection, 32 for segmentation).", false, 0);
+    cmd.add<int>("anchors", 'a', "Anchor count (8400 at 640x640).", false, 8400);
+    cmd.add<int>("iterations", 'n', "Decodes per decoder.", false, 2000);
+    cmd.add<int>("topk", '\0', "Top-k before NMS (0 keeps all).", false, 0);
+    cmd.add<float>("conf", '\0', "Confidence threshold.", false, 0.4f);
+    cmd.parse_check(argc, argv);
+
+    const int classNums = cmd.get<int>("classes");
+    const int maskNums = cmd.get<int>("masks");
+    const int anchors = cmd.get<int>("anchors");
+    const int iterations = std::max(1, cmd.get<int>("iterations"));
+
+    std::vector<float> head((size_t)(4 + classNums + maskNums) * anchors);
+    std::mt19937 rng(7);
+    std::uniform_real_distribution<float> coord(0.0f, 640.0f), background(0.0f, 0.05f), coeff(-1.0f, 1.0f);
+    for (int i = 0; i < anchors; i++)
+    {
+        for (int c = 0; c < 4; c++)
+            head[(size_t)c * anchors + i] = coord(rng);
+        for (int c = 0; c < classNums; c++)
+            head[(size_t)(4 + c) * anchors + i] = background(rng);
+        for (int j = 0; j < maskNums; j++)
+            head[(size_t)(4 + classNums + j) * anchors + i] = coeff(rng);
+        // about one anchor in a hundred is a confident detection
+        if (rng() % 100 == 0)
+            head[(size_t)(4 + rng() % classNums) * anchors + i] = 0.5f + background(rng) * 9.0f;
+    }
+
+    std::vector<int> classes(classNums);
+    std::iota(classes.begin(), classes.end(), 0);
+    std::vector<float> bestConfs;
+    std::vector<int> bestClassIds;
+    DecodeParams params;
+    params.confThreshold = cmd.get<float>("conf");
+    params.topK = cmd.get<int>("topk");
+    params.classes = &classes;
+    params.bestConfs = &bestConfs;
+    params.bestClassIds = &bestClassIds;
+
+    const char *name = nullptr;
+    HeadDecoder specialized = selectHeadDecoder(classNums, maskNums, anchors, &name);
+    HeadDecoder generic = decodeHead<0, 0, 0>;
+
+    auto run = [&](HeadDecoder decoder, HeadCandidates &candidates)
+    {
+        decoder(head.data(), classNums, maskNums, anchors, params, candidates);
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < iterations; i++)
+            decoder(head.data(), classNums, maskNums, anchors, params, candidates);
+        return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / iterations;
+    };
+
+    HeadCandidates genericCandidates, specializedCandidates;
+    double genericUs = run(generic, genericCandidates);
+    double specializedUs = run(specialized, specializedCandidates);
+
+    bool same = genericCandidates.boxes == specializedCandidates.boxes &&
+                genericCandidates.confs == specializedCandidates.confs &&
+                genericCandidates.classIds == specializedCandidates.classIds &&
+                genericCandidates.proposals == specializedCandidates.proposals;
+
+    std::cout << "head " << classNums << " classes, " << maskNums << " masks, " << anchors << " anchors, "
+              << genericCandidates.boxes.size() << " candidates" << std::endl;
+    std::cout << "generic:             " << genericUs << " us/frame" << std::endl;
+    std::cout << "specialized (" << name << "): " << specializedUs << " us/frame, "
+              << genericUs / specializedUs << "x" << std::endl;
+    if (!same)
+    {
+        std::cerr << "Error: specialized and generic decoders disagree" << std::endl;
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,62 @@
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include "cmdline.h"
+#include "yolov8Predictor.h"
+
+// Times host preprocessing and inference of the same frame with a float-input model and
+// its tools/embed_preprocess.py counterpart, and compares the input tensor sizes.
+int main(int argc, char *argv[])
+{
+    cmdline::parser cmd;
+    cmd.add<std::string>("model_path", 'm', "Float-input model (host preprocessing).", false, "yolov8m.onnx");
+    cmd.add<std::string>("embedded", 'e', "The same model rewritten by tools/embed_preprocess.py.", true, "");
+    cmd.add<std::string>("image", 'i', "Frame to preprocess.", true, "");
+    cmd.add<int>("iterations", 'n', "Runs per model.", false, 100);
+    cmd.parse_check(argc, argv);
+
+    cv::Mat image = cv::imread(cmd.get<std::string>("image"));
+    if (image.empty())
+    {
+        std::cerr << "Error: Cannot read " << cmd.get<std::string>("image") << std::endl;
+        return -1;
+    }
+    const int iterations = std::max(1, cmd.get<int>("iterations"));
+
+    size_t detections[2] = {0, 0};
+    const std::string paths[2] = {cmd.get<std::string>("model_path"), cmd.get<std::string>("embedded")};
+    for (int m = 0; m < 2; m++)
+    {
+        try
+        {
+            YOLOPredictor predictor(paths[m], false, 0.4f, 0.4f, 0.5f);
+            LetterboxedInput input;
+            double prepareMs = 0.0, inferMs = 0.0;
+            for (int i = 0; i < iterations; i++)
+            {
+                auto start = std::chrono::steady_clock::now();
+                predictor.prepare(image, input);
+                auto prepared = std::chrono::steady_clock::now();
+                detections[m] = predictor.predict(input).size();
+                auto end = std::chrono::steady_clock::now();
+                prepareMs += std::chrono::duration<double, std::milli>(prepared - start).count();
+                inferMs += std::chrono::duration<double, std::milli>(end - prepared).count();
+            }
+            size_t tensorBytes = input.pixels.empty() ? input.blob.size() * sizeof(float)
+                                                      : input.pixels.total() * input.pixels.elemSize();
+            std::cout << (predictor.byteInput() ? "embedded: " : "host:     ")
+                      << "prepare " << prepareMs / iterations << "ms, predict " << inferMs / iterations
+                      << "ms, input tensor " << tensorBytes / 1024 << "KB, " << detections[m] << " detections" << std::endl;
+        }
+        catch (const std::exception &e)
+        {
+            std::cerr << paths[m] << ": " << e.what() << std::endl;
+            return -1;
+        }
+    }
+    if (detections[0] != detections[1])
+        std::cout << "Detection counts differ: resize and rounding inside the graph are not bit exact" << std::endl;
+    return 0;
+}
@@ -0,0 +1,82 @@
+#include "cascade.h"
+
+#include <algorithm>
+#include <numeric>
+
+cv::Rect cascade::region(const std::vector<Yolov8Result> &screened, const cv::Size &frameSize, const Options &options)
+{
+    cv::Rect frame(cv::Point(0, 0), frameSize);
+    cv::Rect covered;
+    for (const Yolov8Result &result : screened)
+    {
+        if (result.conf < options.screenConf)
+            continue;
+        if (!options.classes.empty() &&
+            std::find(options.classes.begin(), options.classes.end(), result.classId) == options.classes.end())
+            continue;
+        if (!options.regions)
+            return frame;
+
+        int dx = (int)(result.box.width * options.regionMargin);
+        int dy = (int)(result.box.height * options.regionMargin);
+        cv::Rect grown(result.box.x - dx, result.box.y - dy, result.box.width + 2 * dx, result.box.height + 2 * dy);
+        covered = covered.empty() ? grown : (covered | grown);
+    }
+    covered &= frame;
+    if (covered.empty())
+        return cv::Rect();
+    // a crop this large saves little and loses the context around the candidates
+    if (covered.area() > options.maxRegionFraction * frame.area())
+        return frame;
+    return covered;
+}
+
+void cascade::offsetResults(std::vector<Yolov8Result> &results, const cv::Point &offset)
+{
+    for (Yolov8Result &result : results)
+    {
+        result.materialize();
+        result.box += offset;
+        for (std::vector<cv::Point> &contour : result.contours)
+        {
+            for (cv::Point &point : contour)
+                point += offset;
+        }
+    }
+}
+
+size_t cascade::matchDetections(const std::vector<Yolov8Result> &reference, const std::vector<Yolov8Result> &candidate,
+                                float iou)
+{
+    std::vector<size_t> order(reference.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&](size_t a, size_t b)
+              { return reference[a].conf > reference[b].conf; });
+
+    std::vector<bool> used(candidate.size(), false);
+    size_t matched = 0;
+    for (size_t r : order)
+    {
+        const cv::Rect &box = reference[r].box;
+        float best = iou;
+        size_t bestIndex = candidate.size();
+        for (size_t c = 0; c < candidate.size(); c++)
+        {
+            if (used[c] || candidate[c].classId != reference[r].classId)
+                continue;
+            float overlap = (float)(box & candidate[c].box).area();
+            float unionArea = (float)box.area() + (float)candidate[c].box.area() - overlap;
+            if (unionArea > 0 && overlap / unionArea >= best)
+            {
+                best = overlap / unionArea;
+                bestIndex = c;
+            }
+        }
+        if (bestIndex < candidate.size())
+        {
+            used[bestIndex] = true;
+            matched++;
+        }
+    }
+    return matched;
+}
@@ -0,0 +1,166 @@
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <regex>
+#include <string>
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include "cmdline.h"
+#include "cascade.h"
+#include "yolov8Predictor.h"
+
+// Measures a screener + expensive model cascade on local sample images against always
+// running the expensive model: for every screener threshold, the share of frames the
+// expensive model still runs on, the share of its detections the cascade keeps (recall),
+// and the time per frame.
+int main(int argc, char *argv[])
+{
+    cmdline::parser cmd;
+    cmd.add<std::string>("model_path", 'm', "Expensive model, e.g. yolov8m.onnx.", false, "yolov8m.onnx");
+    cmd.add<std::string>("screener", 's', "Cheap screening model, e.g. yolov8n.onnx.", true, "");
+    cmd.add<std::string>("image_path", 'i', "Sample images.", false, "./Imginput");
+    cmd.add<std::string>("screen_conf", '\0', "Screener thresholds to evaluate, t[,t...].", false, "0.05,0.1,0.2,0.3");
+    cmd.add<std::string>("screen_imgsz", '\0', "Screener input size WxH (dynamic-shape screeners), e.g. 320x320.", false, "");
+    cmd.add<std::string>("screen_classes", '\0', "Screener classes that trigger the expensive model (default any).", false, "");
+    cmd.add("regions", '\0', "Run the expensive model on the region around the candidates instead of the frame.");
+    cmd.add<float>("conf", '\0', "Confidence threshold of the expensive model.", false, 0.4f);
+    cmd.add<float>("iou", '\0', "NMS IoU threshold of the expensive model.", false, 0.4f);
+    cmd.add<float>("match_iou", '\0', "IoU at which a cascade detection matches a reference one.", false, 0.5f);
+    cmd.add<int>("images", 'n', "Evaluate at most this many images (0 takes all).", false, 0);
+    cmd.add("gpu", '\0', "Inference on cuda device.");
+    cmd.parse_check(argc, argv);
+
+    std::vector<float> thresholds;
+    for (const std::string &value : utils::split(cmd.get<std::string>("screen_conf"), ','))
+        thresholds.push_back(std::stof(value));
+    if (thresholds.empty())
+    {
+        std::cerr << "Error: no screener thresholds" << std::endl;
+        return -1;
+    }
+    const float lowest = *std::min_element(thresholds.begin(), thresholds.end());
+
+    std::regex pattern(".+\\.(jpg|jpeg|png|gif)$");
+    std::vector<std::string> paths;
+    for (const auto &entry : std::filesystem::directory_iterator(cmd.get<std::string>("image_path")))
+    {
+        if (entry.is_regular_file() && std::regex_match(entry.path().filename().string(), pattern))
+            paths.push_back(entry.path().string());
+    }
+    std::sort(paths.begin(), paths.end());
+    if (cmd.get<int>("images") > 0 && paths.size() > (size_t)cmd.get<int>("images"))
+        paths.resize((size_t)cmd.get<int>("images"));
+    if (paths.empty())
+    {
+        std::cerr << "Error: no images in " << cmd.get<std::string>("image_path") << std::endl;
+        return -1;
+    }
+
+    std::unique_ptr<YOLOPredictor> heavy, screener;
+    try
+    {
+        PredictorOptions heavyOptions;
+        // masks play no part in recall, only boxes are compared
+        heavyOptions.lazyMasks = true;
+        heavy = std::make_unique<YOLOPredictor>(cmd.get<std::string>("model_path"), cmd.exist("gpu"),
+                                                cmd.get<float>("conf"), cmd.get<float>("iou"), 0.5f, heavyOptions);
+        PredictorOptions screenOptions;
+        screenOptions.lazyMasks = true;
+        std::vector<cv::Size> screenSize = utils::parseShapes(cmd.get<std::string>("screen_imgsz"));
+        if (!screenSize.empty())
+            screenOptions.inputSize = screenSize[0];
+        // run once at the lowest threshold, higher ones filter its detections
+        screener = std::make_unique<YOLOPredictor>(cmd.get<std::string>("screener"), cmd.exist("gpu"),
+                                                   lowest, 0.5f, 0.5f, screenOptions);
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return -1;
+    }
+
+    struct Trial
+    {
+        cascade::Options options;
+        size_t heavyRuns = 0;
+        size_t regionRuns = 0;
+        size_t matched = 0;
+        double ms = 0.0;
+    };
+    std::vector<Trial> trials(thresholds.size());
+    for (size_t t = 0; t < thresholds.size(); t++)
+    {
+        trials[t].options.screenConf = thresholds[t];
+        trials[t].options.classes = utils::parseInts(cmd.get<std::string>("screen_classes"));
+        trials[t].options.regions = cmd.exist("regions");
+    }
+
+    auto ms = [](std::chrono::steady_clock::time_point start)
+    { return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count(); };
+    size_t frames = 0, referenceDetections = 0;
+    double heavyMs = 0.0, screenMs = 0.0;
+    for (const std::string &path : paths)
+    {
+        cv::Mat image = cv::imread(path);
+        if (image.empty())
+        {
+            std::cerr << "Error: Cannot read " << path << std::endl;
+            continue;
+        }
+        frames++;
+
+        auto start = std::chrono::steady_clock::now();
+        std::vector<Yolov8Result> reference = heavy->predict(image);
+        double frameHeavyMs = ms(start);
+        start = std::chrono::steady_clock::now();
+        std::vector<Yolov8Result> screened = screener->predict(image);
+        double frameScreenMs = ms(start);
+        heavyMs += frameHeavyMs;
+        screenMs += frameScreenMs;
+        referenceDetections += reference.size();
+
+        for (Trial &trial : trials)
+        {
+            trial.ms += frameScreenMs;
+            cv::Rect region = cascade::region(screened, image.size(), trial.options);
+            if (region.empty())
+                continue;
+            trial.heavyRuns++;
+            if (region.size() == image.size())
+            {
+                // the same frame through the same model, the reference run stands in for it
+                trial.ms += frameHeavyMs;
+                trial.matched += reference.size();
+                continue;
+            }
+            trial.regionRuns++;
+            cv::Mat crop = image(region);
+            start = std::chrono::steady_clock::now();
+            std::vector<Yolov8Result> results = heavy->predict(crop);
+            trial.ms += ms(start);
+            cascade::offsetResults(results, region.tl());
+            trial.matched += cascade::matchDetections(reference, results, cmd.get<float>("match_iou"));
+        }
+    }
+    if (frames == 0)
+        return -1;
+
+    std::cout << std::fixed << std::setprecision(1)
+              << frames << " frames, " << referenceDetections << " detections from the expensive model alone, "
+              << heavyMs / frames << "ms per frame; screener " << screenMs / frames << "ms per frame" << std::endl;
+    for (const Trial &trial : trials)
+    {
+        double recall = referenceDetections ? 100.0 * trial.matched / referenceDetections : 100.0;
+        std::cout << "screen_conf " << std::setprecision(2) << trial.options.screenConf << std::setprecision(1)
+                  << ": expensive model on " << 100.0 * trial.heavyRuns / frames << "% of frames";
+        if (trial.options.regions)
+            std::cout << " (" << trial.regionRuns << " on regions)";
+        std::cout << ", recall " << recall << "% (loss " << 100.0 - recall << "%)"
+                  << ", " << trial.ms / frames << "ms per frame, " << std::setprecision(2)
+                  << heavyMs / std::max(trial.ms, 1e-9) << "x" << std::setprecision(1) << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,101 @@
+#include "folderWatcher.h"
+
+#include <cerrno>
+#include <iostream>
+#include <chrono>
+#include <filesystem>
+#include <stdexcept>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+FolderWatcher::FolderWatcher(const std::string &dir) : dir(dir)
+{
+    inotifyFd = inotify_init1(IN_CLOEXEC);
+    if (inotifyFd < 0)
+        throw std::runtime_error("inotify_init1 failed");
+    if (inotify_add_watch(inotifyFd, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0)
+    {
+        close(inotifyFd);
+        throw std::runtime_error("Cannot watch " + dir);
+    }
+    if (pipe(stopFds) != 0)
+    {
+        close(inotifyFd);
+        throw std::runtime_error("pipe failed");
+    }
+}
+
+FolderWatcher::~FolderWatcher()
+{
+    close(inotifyFd);
+    close(stopFds[0]);
+    close(stopFds[1]);
+}
+
+void FolderWatcher::stop()
+{
+    char byte = 1;
+    ssize_t written = write(stopFds[1], &byte, 1);
+    (void)written;
+}
+
+bool FolderWatcher::readEvents(std::vector<std::string> &paths, int timeoutMs, bool &timedOut)
+{
+    pollfd fds[2] = {{inotifyFd, POLLIN, 0}, {stopFds[0], POLLIN, 0}};
+    timedOut = false;
+    int ready = poll(fds, 2, timeoutMs);
+    if (ready < 0)
+        return errno == EINTR;
+    if (fds[1].revents & POLLIN)
+        return false;
+    if (ready == 0)
+    {
+        timedOut = true;
+        return true;
+    }
+
+    alignas(inotify_event) char buffer[16 * 1024];
+    ssize_t length = read(inotifyFd, buffer, sizeof(buffer));
+    for (ssize_t offset = 0; offset < length;)
+    {
+        const inotify_event *event = (const inotify_event *)(buffer + offset);
+        if (event->mask & IN_Q_OVERFLOW)
+            rescan(paths);
+        else if (event->len > 0 && !(event->mask & IN_ISDIR))
+            paths.push_back(dir + "/" + event->name);
+        offset += sizeof(inotify_event) + event->len;
+    }
+    return true;
+}
+
+void FolderWatcher::rescan(std::vector<std::string> &paths)
+{
+    std::cerr << "Warning: inotify queue overflowed, rescanning " << dir << std::endl;
+    std::error_code ec;
+    for (const auto &entry : std::filesystem::directory_iterator(dir, ec))
+    {
+        if (entry.is_regular_file(ec))
+            paths.push_back(entry.path().string());
+    }
+}
+
+bool FolderWatcher::next(std::vector<std::string> &paths, int batchWindowMs, size_t maxFiles)
+{
+    paths.clear();
+    bool timedOut = false;
+    while (paths.empty())
+    {
+        if (!readEvents(paths, -1, timedOut))
+            return false;
+    }
+    // a burst of drops is handed over together instead of file by file
+    while (paths.size() < maxFiles && batchWindowMs > 0)
+    {
+        if (!readEvents(paths, batchWindowMs, timedOut))
+            return false;
+        if (timedOut)
+            break;
+    }
+    return true;
+}
@@ -0,0 +1,31 @@
+#include "headDecoder.h"
+
+// COCO heads at 640x640: 80 classes, 32 mask coefficients for -seg, 8400 anchors
+HeadDecoder selectHeadDecoder(int classNums, int maskNums, int anchors, const char **name)
+{
+    struct Entry
+    {
+        int classNums, maskNums, anchors;
+        HeadDecoder decoder;
+        const char *name;
+    };
+    static const Entry table[] = {
+        {80, 0, 8400, decodeHead<80, 0, 8400>, "80x0x8400"},
+        {80, 32, 8400, decodeHead<80, 32, 8400>, "80x32x8400"},
+        {80, 0, 0, decodeHead<80, 0, 0>, "80x0xA"},
+        {80, 32, 0, decodeHead<80, 32, 0>, "80x32xA"},
+    };
+    for (const Entry &entry : table)
+    {
+        if (entry.classNums == classNums && entry.maskNums == maskNums &&
+            (entry.anchors == anchors || entry.anchors == 0))
+        {
+            if (name)
+                *name = entry.name;
+            return entry.decoder;
+        }
+    }
+    if (name)
+        *name = "generic";
+    return decodeHead<0, 0, 0>;
+}
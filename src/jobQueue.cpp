@@ -0,0 +1,305 @@
+#include "jobQueue.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+#include <sstream>
+#include <thread>
+#ifdef _WIN32
+#include <process.h>
+#else
+#include <cerrno>
+#include <signal.h>
+#include <unistd.h>
+#endif
+
+#include "utils.h"
+
+namespace fs = std::filesystem;
+
+namespace
+{
+    // a seeder that stopped touching its lock for this long is taken to have crashed
+    constexpr int SEED_LOCK_TIMEOUT_SECONDS = 60;
+
+    // true if workerId names a process on this host that no longer runs; workers on
+    // other hosts can't be checked and are left to the claim timeout
+    bool workerGone(const std::string &workerId)
+    {
+#ifdef _WIN32
+        return false;
+#else
+        size_t dash = workerId.rfind('-');
+        if (dash == std::string::npos || workerId.substr(0, dash) != job::workerId().substr(0, job::workerId().rfind('-')))
+            return false;
+        pid_t pid = (pid_t)std::strtol(workerId.c_str() + dash + 1, nullptr, 10);
+        return pid > 0 && kill(pid, 0) != 0 && errno == ESRCH;
+#endif
+    }
+
+    bool olderThan(const fs::path &path, int seconds)
+    {
+        std::error_code ec;
+        auto modified = fs::last_write_time(path, ec);
+        return !ec && fs::file_time_type::clock::now() - modified >= std::chrono::seconds(seconds);
+    }
+}
+
+std::vector<std::string> job::loadOrBuildManifest(const std::string &root, const std::string &manifestPath,
+                                                  const std::regex &pattern)
+{
+    std::vector<std::string> items;
+    std::ifstream in(manifestPath);
+    if (in)
+    {
+        std::string line;
+        while (std::getline(in, line))
+        {
+            if (!line.empty())
+                items.push_back(line);
+        }
+        return items;
+    }
+
+    for (const auto &entry : fs::recursive_directory_iterator(root, fs::directory_options::skip_permission_denied))
+    {
+        if (entry.is_regular_file() && std::regex_match(entry.path().filename().string(), pattern))
+            items.push_back(fs::relative(entry.path(), root).generic_string());
+    }
+    std::sort(items.begin(), items.end());
+
+    // several workers may build it at once; each writes a private file and renames it into place
+    std::string tmpPath = manifestPath + "." + workerId();
+    {
+        std::ofstream out(tmpPath);
+        for (const std::string &item : items)
+            out << item << '\n';
+    }
+    fs::rename(tmpPath, manifestPath);
+    return items;
+}
+
+bool job::parseShard(const std::string &spec, int &index, int &count)
+{
+    char slash = 0;
+    std::istringstream stream(spec);
+    if (!(stream >> index >> slash >> count) || slash != '/' || count <= 0 || index < 0 || index >= count)
+        return false;
+    return true;
+}
+
+bool job::inShard(const std::string &item, int index, int count)
+{
+    return utils::hashBytes(item.data(), item.size()) % (uint64_t)count == (uint64_t)index;
+}
+
+std::string job::workerId()
+{
+#ifdef _WIN32
+    const char *host = std::getenv("COMPUTERNAME");
+    return std::string(host ? host : "host") + "-" + std::to_string(_getpid());
+#else
+    char host[256] = {0};
+    gethostname(host, sizeof(host) - 1);
+    return std::string(host) + "-" + std::to_string(getpid());
+#endif
+}
+
+job::CheckpointLog::CheckpointLog(const std::string &dir, const std::string &name)
+{
+    fs::create_directories(dir);
+    for (const auto &entry : fs::directory_iterator(dir))
+    {
+        if (entry.path().extension() != ".log")
+            continue;
+        std::ifstream in(entry.path());
+        std::string line;
+        // a line cut short by a crash has no newline, std::getline then stops at eof
+        while (std::getline(in, line) && !in.eof())
+            completed.insert(line);
+    }
+    log.open(fs::path(dir) / (name + ".log"), std::ios::app);
+    if (!log)
+        throw std::runtime_error("Cannot open checkpoint log in " + dir);
+}
+
+bool job::CheckpointLog::done(const std::string &item) const
+{
+    return completed.count(item) != 0;
+}
+
+void job::CheckpointLog::markDone(const std::string &item)
+{
+    log << item << '\n';
+    log.flush();
+    completed.insert(item);
+}
+
+size_t job::CheckpointLog::doneCount() const
+{
+    return completed.size();
+}
+
+job::DirectoryQueue::DirectoryQueue(const std::string &dir, const std::string &workerId)
+    : dir(dir), id(workerId)
+{
+    fs::create_directories(fs::path(dir) / "claimed");
+    fs::create_directories(fs::path(dir) / "done");
+    fs::create_directories(fs::path(dir) / "failed");
+}
+
+void job::DirectoryQueue::seed(const std::vector<std::string> &items, size_t chunkSize)
+{
+    fs::path pending = fs::path(dir) / "pending";
+    fs::path lock = fs::path(dir) / "seed.lock";
+    // mkdir is atomic, exactly one worker wins the lock and writes the chunks
+    while (!fs::exists(pending) && !fs::create_directory(lock))
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        // the seeder names itself in the lock and touches it while it writes; a lock whose
+        // seeder died is moved aside (a rename, so one waiter wins) and seeding starts over
+        bool dead = false;
+        std::error_code ec;
+        for (const auto &entry : fs::directory_iterator(lock, ec))
+            dead = dead || workerGone(entry.path().filename().string());
+        if (!fs::exists(pending) && (dead || olderThan(lock, SEED_LOCK_TIMEOUT_SECONDS)))
+        {
+            fs::path stale = fs::path(dir) / ("seed.lock.stale-" + id);
+            fs::rename(lock, stale, ec);
+            if (!ec)
+            {
+                std::cerr << "Warning: breaking the seed lock of a stopped worker" << std::endl;
+                fs::remove_all(stale, ec);
+            }
+        }
+    }
+    if (!fs::exists(pending))
+    {
+        std::ofstream(lock / id).close();
+        fs::path staging = fs::path(dir) / ("staging-" + id);
+        fs::remove_all(staging);
+        fs::create_directories(staging);
+        chunkSize = std::max<size_t>(1, chunkSize);
+        auto touched = std::chrono::steady_clock::now();
+        for (size_t begin = 0, chunk = 0; begin < items.size(); begin += chunkSize, chunk++)
+        {
+            if (std::chrono::steady_clock::now() - touched > std::chrono::seconds(5))
+            {
+                std::error_code ec;
+                fs::last_write_time(lock, fs::file_time_type::clock::now(), ec);
+                touched = std::chrono::steady_clock::now();
+            }
+            char name[32];
+            std::snprintf(name, sizeof(name), "chunk-%08zu.txt", chunk);
+            std::ofstream out(staging / name);
+            for (size_t i = begin; i < std::min(items.size(), begin + chunkSize); i++)
+                out << items[i] << '\n';
+        }
+        // pending appears with every chunk in it at once
+        fs::rename(staging, pending);
+        std::cout << "Queue seeded with " << (items.size() + chunkSize - 1) / chunkSize << " chunks" << std::endl;
+    }
+}
+
+bool job::DirectoryQueue::claim(std::vector<std::string> &items)
+{
+    items.clear();
+    fs::path pending = fs::path(dir) / "pending";
+    std::error_code ec;
+    for (const auto &entry : fs::directory_iterator(pending, ec))
+    {
+        fs::path target = fs::path(dir) / "claimed" / (entry.path().filename().string() + "." + id);
+        std::error_code renameError;
+        fs::rename(entry.path(), target, renameError);
+        // another worker took it first
+        if (renameError)
+            continue;
+
+        claimed = target.string();
+        heartbeat();
+        std::ifstream in(target);
+        std::string line;
+        while (std::getline(in, line))
+        {
+            if (!line.empty())
+                items.push_back(line);
+        }
+        return true;
+    }
+    return false;
+}
+
+void job::DirectoryQueue::heartbeat()
+{
+    std::error_code ec;
+    if (!claimed.empty())
+        fs::last_write_time(claimed, fs::file_time_type::clock::now(), ec);
+}
+
+void job::DirectoryQueue::complete(const std::vector<std::string> &failed, int maxRetries)
+{
+    if (claimed.empty())
+        return;
+    std::string name = fs::path(claimed).filename().string();
+    std::error_code ec;
+    if (!failed.empty())
+    {
+        // chunk-N.txt fails into chunk-N-retry1.txt, that one into chunk-N-retry2.txt, ...
+        std::string chunk = name.substr(0, name.find(".txt"));
+        int retry = 0;
+        size_t mark = chunk.rfind("-retry");
+        if (mark != std::string::npos)
+        {
+            retry = std::atoi(chunk.c_str() + mark + 6);
+            chunk = chunk.substr(0, mark);
+        }
+        bool givingUp = retry >= maxRetries;
+        fs::path target = givingUp ? fs::path(dir) / "failed" / (chunk + ".txt")
+                                   : fs::path(dir) / "pending" / (chunk + "-retry" + std::to_string(retry + 1) + ".txt");
+        // written aside and renamed, so no worker claims a half-written chunk
+        fs::path staging = fs::path(dir) / ("retry-" + id + ".tmp");
+        {
+            std::ofstream out(staging);
+            for (const std::string &item : failed)
+                out << item << '\n';
+        }
+        fs::rename(staging, target, ec);
+        if (ec)
+            std::cerr << "Warning: could not requeue " << failed.size() << " failed items: " << ec.message() << std::endl;
+        else if (givingUp)
+            std::cerr << "Warning: " << failed.size() << " items failed " << retry + 1 << " times, listed in " << target.string() << std::endl;
+    }
+    fs::rename(claimed, fs::path(dir) / "done" / name.substr(0, name.find(".txt") + 4), ec);
+    if (ec)
+        std::cerr << "Warning: could not complete " << claimed << ": " << ec.message() << std::endl;
+    claimed.clear();
+}
+
+int job::DirectoryQueue::requeueStale(int maxAgeSeconds)
+{
+    int requeued = 0;
+    auto now = fs::file_time_type::clock::now();
+    std::error_code ec;
+    for (const auto &entry : fs::directory_iterator(fs::path(dir) / "claimed", ec))
+    {
+        std::string name = entry.path().filename().string();
+        if (entry.path().string() == claimed)
+            continue;
+        // claimed files are named chunk-N.txt.<worker id>
+        size_t owner = name.find(".txt.");
+        bool dead = owner != std::string::npos && workerGone(name.substr(owner + 5));
+        std::error_code timeError;
+        auto modified = fs::last_write_time(entry.path(), timeError);
+        bool idle = maxAgeSeconds > 0 && !timeError && now - modified >= std::chrono::seconds(maxAgeSeconds);
+        if (!dead && !idle)
+            continue;
+        std::error_code renameError;
+        fs::rename(entry.path(), fs::path(dir) / "pending" / name.substr(0, name.find(".txt") + 4), renameError);
+        if (!renameError)
+            requeued++;
+    }
+    return requeued;
+}
@@ -0,0 +1,198 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <regex>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+#include "cmdline.h"
+#include "protocol.h"
+
+typedef std::chrono::steady_clock Clock;
+
+struct Sample
+{
+    int32_t status;
+    double latencyMs;
+    float queueMs;
+    float inferMs;
+};
+
+// one request on an open connection, -1 status on a transport error
+static Sample sendRequest(int fd, const std::vector<char> &payload, uint32_t deadlineMs, Clock::time_point start)
+{
+    Sample sample{-1, 0.0, 0.0f, 0.0f};
+    protocol::RequestHeader header{protocol::MAGIC, deadlineMs, (uint32_t)payload.size()};
+    protocol::ResponseHeader response;
+    if (protocol::sendAll(fd, &header, sizeof(header)) &&
+        protocol::sendAll(fd, payload.data(), payload.size()) &&
+        protocol::recvAll(fd, &response, sizeof(response)))
+    {
+        std::vector<protocol::Detection> detections(response.count);
+        if (protocol::recvAll(fd, detections.data(), detections.size() * sizeof(protocol::Detection)))
+        {
+            sample.status = response.status;
+            sample.queueMs = response.queueMs;
+            sample.inferMs = response.inferMs;
+        }
+    }
+    sample.latencyMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    return sample;
+}
+
+static double percentile(const std::vector<double> &sorted, double q)
+{
+    if (sorted.empty())
+        return 0.0;
+    size_t index = std::min(sorted.size() - 1, (size_t)(q * (double)sorted.size()));
+    return sorted[index];
+}
+
+int main(int argc, char *argv[])
+{
+    cmdline::parser cmd;
+    cmd.add<std::string>("socket", 's', "Unix domain socket of yolov8_serve.", false, "/tmp/yolov8.sock");
+    cmd.add<std::string>("image_path", 'i', "Images sent round-robin as request payloads.", false, "./Imginput");
+    cmd.add<std::string>("mode", '\0', "closed: fixed clients back to back, open: Poisson arrivals at --rate.", false, "closed",
+                         cmdline::oneof<std::string>("closed", "open"));
+    cmd.add<int>("concurrency", 'n', "Clients (closed) or connections (open).", false, 4);
+    cmd.add<double>("rate", 'r', "Open-loop arrival rate in requests per second.", false, 10.0);
+    cmd.add<int>("duration", 't', "Seconds to generate load.", false, 10);
+    cmd.add<int>("deadline_ms", 'd', "Per-request deadline sent to the server (0 uses its default).", false, 0);
+    cmd.parse_check(argc, argv);
+
+    const std::string socketPath = cmd.get<std::string>("socket");
+    const std::string imagePath = cmd.get<std::string>("image_path");
+    const bool openLoop = cmd.get<std::string>("mode") == "open";
+    const int concurrency = std::max(1, cmd.get<int>("concurrency"));
+    const double rate = cmd.get<double>("rate");
+    const auto duration = std::chrono::seconds(std::max(1, cmd.get<int>("duration")));
+    const uint32_t deadlineMs = (uint32_t)std::max(0, cmd.get<int>("deadline_ms"));
+
+    std::vector<std::vector<char>> payloads;
+    std::regex pattern(".+\\.(jpg|jpeg|png)$");
+    if (std::filesystem::is_directory(imagePath))
+    {
+        for (const auto &entry : std::filesystem::directory_iterator(imagePath))
+        {
+            if (!std::filesystem::is_regular_file(entry.path()) || !std::regex_match(entry.path().filename().string(), pattern))
+                continue;
+            std::ifstream file(entry.path(), std::ios::binary);
+            payloads.emplace_back(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        }
+    }
+    if (payloads.empty())
+    {
+        std::cerr << "Error: No images in " << imagePath << std::endl;
+        return -1;
+    }
+
+    // open loop: arrivals are fixed up front, so a slow server cannot slow the arrivals down;
+    // latency counts from the scheduled arrival, including time spent waiting for a free connection
+    std::vector<Clock::time_point> schedule;
+    Clock::time_point begin = Clock::now() + std::chrono::milliseconds(100);
+    if (openLoop)
+    {
+        std::mt19937 rng(42);
+        std::exponential_distribution<double> gap(rate);
+        double t = 0.0;
+        while (t < (double)duration.count())
+        {
+            schedule.push_back(begin + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(t)));
+            t += gap(rng);
+        }
+    }
+
+    std::vector<Sample> samples;
+    std::mutex samplesMutex;
+    std::atomic<size_t> next{0};
+    Clock::time_point end = begin + duration;
+
+    std::vector<std::thread> clients;
+    for (int c = 0; c < concurrency; c++)
+    {
+        clients.emplace_back([&, c]
+                             {
+            int fd = protocol::connectUnix(socketPath);
+            if (fd < 0)
+                return;
+            std::vector<Sample> local;
+            std::this_thread::sleep_until(begin);
+            while (true)
+            {
+                size_t index = next++;
+                Clock::time_point start;
+                if (openLoop)
+                {
+                    if (index >= schedule.size())
+                        break;
+                    start = schedule[index];
+                    std::this_thread::sleep_until(start);
+                }
+                else
+                {
+                    start = Clock::now();
+                    if (start >= end)
+                        break;
+                }
+                Sample sample = sendRequest(fd, payloads[(index + c) % payloads.size()], deadlineMs, start);
+                local.push_back(sample);
+                if (sample.status < 0)
+                {
+                    // the server dropped the connection, reconnect for the next request
+                    close(fd);
+                    fd = protocol::connectUnix(socketPath);
+                    if (fd < 0)
+                        break;
+                }
+            }
+            if (fd >= 0)
+                close(fd);
+            std::lock_guard<std::mutex> lock(samplesMutex);
+            samples.insert(samples.end(), local.begin(), local.end()); });
+    }
+    for (std::thread &client : clients)
+        client.join();
+    double elapsed = std::chrono::duration<double>(Clock::now() - begin).count();
+
+    size_t counts[5] = {0, 0, 0, 0, 0};
+    std::vector<double> latencies;
+    double queueMs = 0.0, inferMs = 0.0;
+    for (const Sample &sample : samples)
+    {
+        counts[sample.status < 0 ? 4 : std::min<int32_t>(sample.status, 3)]++;
+        if (sample.status == protocol::OK)
+        {
+            latencies.push_back(sample.latencyMs);
+            queueMs += sample.queueMs;
+            inferMs += sample.inferMs;
+        }
+    }
+    std::sort(latencies.begin(), latencies.end());
+
+    std::cout << "mode " << (openLoop ? "open" : "closed")
+              << (openLoop ? " rate " + std::to_string(rate) + "/s" : "")
+              << " concurrency " << concurrency << " duration " << elapsed << "s" << std::endl;
+    std::cout << "requests " << samples.size()
+              << " ok " << counts[protocol::OK]
+              << " busy " << counts[protocol::BUSY]
+              << " timeout " << counts[protocol::TIMEOUT]
+              << " bad_request " << counts[protocol::BAD_REQUEST]
+              << " transport_error " << counts[4] << std::endl;
+    std::cout << "throughput " << (double)counts[protocol::OK] / elapsed << " req/s" << std::endl;
+    if (!latencies.empty())
+    {
+        std::cout << "latency ms p50 " << percentile(latencies, 0.50)
+                  << " p90 " << percentile(latencies, 0.90)
+                  << " p99 " << percentile(latencies, 0.99)
+                  << " max " << latencies.back() << std::endl;
+        std::cout << "server ms queue " << queueMs / (double)latencies.size()
+                  << " infer " << inferMs / (double)latencies.size() << std::endl;
+    }
+    return 0;
+}
@@ -2,31 +2,767 @@
 #include <iostream>
 #include <opencv2/opencv.hpp>
 #include <filesystem>
-#include <ctime>
+#include <chrono>
+#include <thread>
+#include <fstream>
+#include <map>
+#include <mutex>
 #include "cmdline.h"
 #include "utils.h"
 #include "yolov8Predictor.h"
+#include "modelRegistry.h"
+#include "jobQueue.h"
+#include "metrics.h"
+#include "pipeline.h"
+#include "mosaic.h"
+#include "tuneProfile.h"
+#ifdef __linux__
+#include <csignal>
+#include "folderWatcher.h"
+#include "shmRing.h"
 
-int main(int argc, char *argv[])
+// the watcher of --watch mode, stopped by SIGINT/SIGTERM so files in flight still finish
+static FolderWatcher *activeWatcher = nullptr;
+static void stopWatching(int)
 {
-    float confThreshold = 0.4f;
-    float iouThreshold = 0.4f;
-
-    float maskThreshold = 0.5f;
+    if (activeWatcher)
+        activeWatcher->stop();
+}
+#endif
 
-    cmdline::parser cmd;
+static void addFlags(cmdline::parser &cmd)
+{
     cmd.add<std::string>("model_path", 'm', "Path to onnx model.", false, "yolov8m.onnx");
     cmd.add<std::string>("image_path", 'i', "Image source to be predicted.", false, "./Imginput");
     cmd.add<std::string>("out_path", 'o', "Path to save result.", false, "./Imgoutput");
     cmd.add<std::string>("class_names", 'c', "Path to class names file.", false, "coco.names");
 
     cmd.add<std::string>("suffix_name", 'x', "Suffix names.", false, "yolov8m");
+    cmd.add<std::string>("models", '\0', "Several models sharing one process, suffix:path[,suffix:path...]. Overrides -m/-x.", false, "");
+    cmd.add<int>("threads", '\0', "Intra-op threads shared by all models (0 lets ORT decide).", false, 0);
+    cmd.add<std::string>("ort_cpus", '\0', "Pin one intra-op thread to each of these cpus, e.g. 4-15 (overrides --threads).", false, "");
+    cmd.add<std::string>("pipeline", '\0', "Decode, infer and encode workers, e.g. 2,1,2 (default runs frames one by one).", false, "");
+    cmd.add<std::string>("pin", '\0', "Cpus of the decode, infer and encode workers, e.g. 0-1;2-3;16-17.", false, "");
+    cmd.add<int>("numa_node", '\0', "Keep every thread and allocation on this NUMA node (-1 disables).", false, -1);
 
     cmd.add("gpu", '\0', "Inference on cuda device.");
+    cmd.add<std::string>("shm", '\0', "Read raw BGR frames from this shared-memory ring instead of -i (Linux).", false, "");
+    cmd.add("no_save", '\0', "Skip drawing and saving results, for throughput runs.");
+    cmd.add<int>("cache_mb", '\0', "Memory budget of the result cache in MB (0 disables caching).", false, 0);
+    cmd.add<std::string>("cache_dir", '\0', "Directory of the on-disk result cache tier.", false, "");
+    cmd.add<int>("cache_disk_mb", '\0', "Disk budget of the on-disk tier in MB (0 is unbounded).", false, 0);
+    cmd.add<std::string>("profile", '\0', "Tuning profile from yolov8_tune; flags given on the command line take precedence.", false, "");
+    cmd.add<int>("batch", '\0', "Frames per session run when running frames one by one (dynamic-batch models).", false, 1);
+    cmd.add<std::string>("imgsz", '\0', "Input size WxH for dynamic-shape models, e.g. 640x384.", false, "");
+    cmd.add<std::string>("classes", '\0', "Class ids to detect, n[,n...] (default all).", false, "");
+    cmd.add<int>("topk", '\0', "Keep at most this many candidates before NMS (0 keeps all).", false, 0);
+    cmd.add<int>("max_per_class", '\0', "Keep at most this many detections per class (0 keeps all).", false, 0);
+    cmd.add<int>("finalize_threads", '\0', "Finalize detections (mask upsample, rescale) on a pool of this many threads (0 finalizes inline).", false, 0);
+    cmd.add<int>("mosaic", '\0', "Pack images no larger than this many pixels per side onto shared canvases, one run per canvas (0 disables).", false, 0);
+    cmd.add<int>("mosaic_gutter", '\0', "Padding between packed images in pixels.", false, 16);
+    cmd.add<int>("memory_budget_mb", '\0', "Memory budget of the process in MB: caps ORT's arena at half of it, bounds frames in flight and crops masks when memory gets tight (0 disables).", false, 0);
+    cmd.add<int>("arena_max_mb", '\0', "Cap ORT's memory arena at this many MB and grow it by what each run needs (0 leaves it unbounded).", false, 0);
+    cmd.add<int>("max_in_flight", '\0', "Pipeline mode: at most this many frames between decode and saved results (0 leaves it to the queues).", false, 0);
+    cmd.add("crop_masks", '\0', "Compute each mask only inside its box instead of upsampling a full-frame mask per detection.");
+    cmd.add("lazy_masks", '\0', "Keep mask coefficients and compute each mask only when it is drawn (with --no_save, never).");
+    cmd.add("contours", '\0', "Segmentation: trace the outline of every mask and draw it (overrides --lazy_masks).");
+    cmd.add("memory_stats", '\0', "Track resident memory per stage and print a memory summary at the end.");
+    cmd.add<std::string>("screener", '\0', "Cascade: cheap model run first, the models run only on frames where it finds candidates.", false, "");
+    cmd.add<float>("screen_conf", '\0', "Cascade: screener confidence that triggers the models; keep it low for recall.", false, 0.1f);
+    cmd.add<std::string>("screen_imgsz", '\0', "Cascade: screener input size WxH (dynamic-shape screeners), e.g. 320x320.", false, "");
+    cmd.add<std::string>("screen_classes", '\0', "Cascade: screener classes that trigger the models, n[,n...] (default any).", false, "");
+    cmd.add("cascade_regions", '\0', "Cascade: run the models on the region around the screener's candidates instead of the frame.");
+    cmd.add("no_warmup", '\0', "Skip the warmup run at startup.");
+    cmd.add("mmap_model", '\0', "Build sessions from an mmapped model file (.ort models always are).");
+    cmd.add<std::string>("optimized_model", '\0', "Save the optimized graph here, to load instead of the model next time.", false, "");
+    cmd.add("profile_startup", '\0', "Report model parse and session initialization times from ORT's profiler.");
+    cmd.add<std::string>("warmup_shapes", '\0', "Shapes to warm up, WxH[,WxH...].", false, "");
+    cmd.add<std::string>("warmup_batch", '\0', "Batch sizes to warm up, n[,n...].", false, "1");
+    cmd.add<int>("bucket_step", '\0', "Pin dynamic-shape models to multiples of this stride (0 disables).", false, 0);
+    cmd.add("watch", '\0', "Daemon mode: keep the models warm and process files as they are written into -i (Linux).");
+    cmd.add<std::string>("done_dir", '\0', "Watch mode: move processed files here (default marks them with a .done file).", false, "");
+    cmd.add<int>("watch_batch_ms", '\0', "Watch mode: files arriving within this many ms of each other are queued in one wakeup; each is still inferred on its own.", false, 20);
+    cmd.add<std::string>("job_dir", '\0', "Job mode: recurse into -i, keep the manifest and checkpoints here and resume from them.", false, "");
+    cmd.add<std::string>("shard", '\0', "Job mode: process shard i of N, as i/N.", false, "0/1");
+    cmd.add("queue", '\0', "Job mode: claim manifest chunks from a queue in --job_dir instead of sharding.");
+    cmd.add<int>("chunk_size", '\0', "Job mode: items per queue chunk.", false, 1000);
+    cmd.add<int>("metrics_port", '\0', "Serve Prometheus metrics on this localhost port (0 disables).", false, 0);
+    cmd.add<int>("metrics_interval", '\0', "Seconds between metrics snapshot lines (0 disables).", false, 0);
+    cmd.add<int>("claim_timeout", '\0', "Job mode: requeue chunks claimed by a worker idle this many seconds (0 only requeues those of exited workers on this host).", false, 600);
+}
+
+// settings yolov8_tune measures; a --profile fills in every one not given as a flag
+struct TunedSettings
+{
+    int threads = 0;
+    int batchSize = 1;
+    // decode, infer and encode workers, empty runs frames one by one
+    std::vector<int> stageWorkers;
+    cv::Size inputSize;
+};
+
+static bool loadTunedSettings(cmdline::parser &cmd, TunedSettings &tuned)
+{
+    TuneProfile profile;
+    const bool useProfile = !cmd.get<std::string>("profile").empty();
+    if (useProfile)
+    {
+        try
+        {
+            profile = TuneProfile::load(cmd.get<std::string>("profile"));
+        }
+        catch (const std::exception &e)
+        {
+            std::cerr << "Error: " << e.what() << std::endl;
+            return false;
+        }
+        std::cout << "Tuning profile :::" << cmd.get<std::string>("profile") << std::endl;
+    }
+    auto fromProfile = [&](const std::string &flag)
+    { return useProfile && !cmd.exist(flag); };
+    tuned.threads = fromProfile("threads") ? profile.threads : cmd.get<int>("threads");
+    tuned.batchSize = std::max(1, fromProfile("batch") ? profile.batch : cmd.get<int>("batch"));
+    tuned.stageWorkers = fromProfile("pipeline") ? profile.pipeline : utils::parseInts(cmd.get<std::string>("pipeline"));
+    std::vector<cv::Size> imgsz = utils::parseShapes(cmd.get<std::string>("imgsz"));
+    if (!imgsz.empty())
+        tuned.inputSize = imgsz[0];
+    else if (fromProfile("imgsz"))
+        tuned.inputSize = profile.inputSize;
+
+    // watch mode always overlaps decode, inference and encode
+    if (cmd.exist("watch") && tuned.stageWorkers.empty())
+        tuned.stageWorkers = {1, 1, 1};
+    // the pipelined path runs frames one by one; a profile's batch size is only a fallback
+    // for runs without it, but flags asking for both are a mistake
+    if (!tuned.stageWorkers.empty() && (cmd.get<int>("mosaic") > 0 || (cmd.exist("batch") && tuned.batchSize > 1)))
+    {
+        std::cerr << "Error: --pipeline and --watch run frames one by one, they can't be combined with --mosaic or --batch" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+static PredictorOptions predictorOptions(cmdline::parser &cmd, const TunedSettings &tuned)
+{
+    PredictorOptions options;
+    options.inputSize = tuned.inputSize;
+    options.classes = utils::parseInts(cmd.get<std::string>("classes"));
+    options.topK = cmd.get<int>("topk");
+    options.maxPerClass = cmd.get<int>("max_per_class");
+    options.warmup = !cmd.exist("no_warmup");
+    options.mmapModel = cmd.exist("mmap_model");
+    options.optimizedModelPath = cmd.get<std::string>("optimized_model");
+    options.profileStartup = cmd.exist("profile_startup");
+    options.warmupShapes = utils::parseShapes(cmd.get<std::string>("warmup_shapes"));
+    options.warmupBatchSizes = utils::parseInts(cmd.get<std::string>("warmup_batch"));
+    if (tuned.batchSize > 1 && !cmd.exist("warmup_batch"))
+        options.warmupBatchSizes = {1, tuned.batchSize};
+    options.bucketStep = cmd.get<int>("bucket_step");
+
+    // a budget picks conservative defaults for every knob not given explicitly
+    const size_t memoryBudget = (size_t)cmd.get<int>("memory_budget_mb") << 20;
+    options.memoryBudget = memoryBudget;
+    options.arenaMaxBytes = (size_t)cmd.get<int>("arena_max_mb") << 20;
+    if (memoryBudget > 0 && !cmd.exist("arena_max_mb"))
+        options.arenaMaxBytes = memoryBudget / 2;
+    options.arenaExtendSameAsRequested = options.arenaMaxBytes > 0;
+    options.cropMasks = cmd.exist("crop_masks");
+    options.lazyMasks = cmd.exist("lazy_masks");
+    options.contours = cmd.exist("contours");
+    if (cmd.get<int>("cache_mb") > 0)
+    {
+        options.resultCache = std::make_shared<ResultCache>((size_t)cmd.get<int>("cache_mb") << 20,
+                                                            cmd.get<std::string>("cache_dir"),
+                                                            (size_t)cmd.get<int>("cache_disk_mb") << 20);
+    }
+    return options;
+}
+
+// adds every model, and the screener when one is given, to registry
+static bool loadModels(cmdline::parser &cmd, ModelRegistry &registry,
+                       const std::vector<std::pair<std::string, std::string>> &models,
+                       const PredictorOptions &options, const std::vector<std::string> &classNames)
+{
+    const float confThreshold = 0.4f;
+    const float iouThreshold = 0.4f;
+    const float maskThreshold = 0.5f;
+    const bool isGPU = cmd.exist("gpu");
+    try
+    {
+        for (const auto &model : models)
+        {
+            YOLOPredictor &predictor = registry.add(model.first, model.second, isGPU,
+                                                    confThreshold,
+                                                    iouThreshold,
+                                                    maskThreshold,
+                                                    options);
+            assert(classNames.size() == predictor.classNums);
+        }
+        if (!cmd.get<std::string>("screener").empty())
+        {
+            cascade::Options cascadeOptions;
+            cascadeOptions.screenConf = cmd.get<float>("screen_conf");
+            cascadeOptions.classes = utils::parseInts(cmd.get<std::string>("screen_classes"));
+            cascadeOptions.regions = cmd.exist("cascade_regions");
+            PredictorOptions screenerOptions;
+            std::vector<cv::Size> screenSize = utils::parseShapes(cmd.get<std::string>("screen_imgsz"));
+            if (!screenSize.empty())
+                screenerOptions.inputSize = screenSize[0];
+            screenerOptions.warmup = options.warmup;
+            screenerOptions.mmapModel = options.mmapModel;
+            registry.setScreener(cmd.get<std::string>("screener"), isGPU, cascadeOptions, screenerOptions);
+            std::cout << "Screener :::" << cmd.get<std::string>("screener") << std::endl;
+        }
+        std::cout << "Model was initialized." << std::endl;
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << e.what() << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// what every driver below works with
+struct RunContext
+{
+    cmdline::parser &cmd;
+    ModelRegistry &registry;
+    const PredictorOptions &options;
+    const std::vector<std::string> &classNames;
+    const std::string imagePath;
+    const std::string savePath;
+    const std::regex pattern;
+    const bool saveResults;
+    // frames handled, for the throughput summary
+    int picNums = 0;
+};
+
+// counts one predicted frame and optionally saves it, once per model;
+// safe to call from several encode workers at once
+static void finishFrame(RunContext &run, cv::Mat &image, const std::vector<std::vector<Yolov8Result>> &results,
+                        const std::string &baseName, const std::filesystem::path &outDir)
+{
+    thread_local cv::Mat renderBuffer;
+    metrics::add(metrics::FRAMES);
+    for (size_t i = 0; run.saveResults && i < results.size(); i++)
+    {
+        // the last model renders in place, earlier ones need an untouched frame
+        cv::Mat canvas = i + 1 < results.size() ? image.clone() : image;
+        utils::visualizeDetection(canvas, results[i], run.classNames, renderBuffer);
+
+        std::string newFilename = baseName.substr(0, baseName.find_last_of('.')) + "_" + run.registry.modelNames()[i] + baseName.substr(baseName.find_last_of('.'));
+        std::string outputFilename = (outDir / newFilename).string();
+        cv::imwrite(outputFilename, canvas);
+        std::cout << outputFilename << " Saved !!!" << std::endl;
+    }
+}
 
+// decode half of one file, false when it could not be read; with a cache, the raw
+// file bytes are checked before anything is decoded, and a hit is only decoded to be saved
+static bool decodeFile(RunContext &run, PipelineFrame &frame)
+{
+    auto decodeStart = std::chrono::steady_clock::now();
+    if (run.options.resultCache)
+    {
+        std::ifstream in(frame.path, std::ios::binary);
+        std::vector<uchar> bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        // imdecode asserts on no input where imread returns an empty Mat
+        if (bytes.empty())
+            return false;
+        frame.fileHash = utils::hashBytes(bytes.data(), bytes.size());
+        frame.fileBytes = bytes.size();
+        frame.cached = run.registry.lookupAll(frame.fileHash, frame.results, bytes.size());
+        if (frame.cached && !run.saveResults)
+            return true;
+        frame.image = cv::imdecode(bytes, cv::IMREAD_COLOR);
+    }
+    else
+        frame.image = cv::imread(frame.path);
+    metrics::observe(metrics::STAGE_DECODE, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - decodeStart).count());
+    return !frame.image.empty();
+}
+
+// inference half, skipped on a cache hit
+static void inferFile(RunContext &run, PipelineFrame &frame)
+{
+    if (frame.cached)
+        return;
+    if (!run.options.resultCache)
+    {
+        frame.results = run.registry.predictAll(frame.image);
+        return;
+    }
+    // cached under the file hash only, the models' pixel-hash entries would be
+    // a second miss and a second copy of the same results
+    frame.results = run.registry.predictAll(frame.image, false);
+    run.registry.storeAll(frame.fileHash, frame.results, frame.fileBytes);
+}
+
+// decodes, predicts and optionally saves one file, false when it could not be read
+static bool processFile(RunContext &run, const std::filesystem::path &file, const std::filesystem::path &outDir)
+{
+    PipelineFrame frame{file.string(), cv::Mat(), {}};
+    std::cout << frame.path << " predicting..." << std::endl;
+    metrics::ScopedTimer timer(metrics::STAGE_TOTAL);
+    if (!decodeFile(run, frame))
+        return false;
+    inferFile(run, frame);
+    finishFrame(run, frame.image, frame.results, file.filename().string(), outDir);
+    return true;
+}
+
+#ifdef __linux__
+// frames are read in place from the producer's ring, no decode and no copy before preprocessing
+static bool runSharedMemory(RunContext &run, const std::string &shmName, std::chrono::steady_clock::time_point &startTime)
+{
+    std::unique_ptr<ShmFrameRing> ring;
+    for (int attempt = 0; !ring; attempt++)
+    {
+        try
+        {
+            ring = std::make_unique<ShmFrameRing>(shmName);
+        }
+        catch (const std::exception &e)
+        {
+            if (attempt == 50)
+            {
+                std::cerr << e.what() << std::endl;
+                return false;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        }
+    }
+    std::cout << "Frames from :::" << shmName << std::endl;
+    startTime = std::chrono::steady_clock::now();
+
+    cv::Mat frame;
+    uint64_t frameId = 0;
+    size_t detectionNums = 0;
+    metrics::setGaugeSource(metrics::QUEUE_DEPTH, [&ring]
+                            { return (int64_t)ring->pending(); });
+    while (ring->acquireRead(frame, frameId))
+    {
+        metrics::ScopedTimer timer(metrics::STAGE_TOTAL);
+        std::vector<std::vector<Yolov8Result>> results = run.registry.predictAll(frame);
+        ring->release();
+        metrics::add(metrics::FRAMES);
+        run.picNums += 1;
+        for (const auto &result : results)
+            detectionNums += result.size();
+        if (run.picNums % 100 == 0)
+            std::cout << run.picNums << " frames, " << detectionNums << " detections" << std::endl;
+    }
+    metrics::setGaugeSource(metrics::QUEUE_DEPTH, nullptr);
+    return true;
+}
+#endif
+
+// job mode: the manifest of jobDir split by shard or claimed from its queue, resumable
+static void runJob(RunContext &run, const std::string &jobDir, int shardIndex, int shardCount)
+{
+    cmdline::parser &cmd = run.cmd;
+    // outputs mirror the input tree, so equal file names in different folders do not collide;
+    // false if the item failed
+    auto processItem = [&](const std::string &item, job::CheckpointLog &log)
+    {
+        if (log.done(item))
+            return true;
+        std::filesystem::path outDir = std::filesystem::path(run.savePath) / std::filesystem::path(item).parent_path();
+        if (run.saveResults)
+            std::filesystem::create_directories(outDir);
+        try
+        {
+            if (!processFile(run, std::filesystem::path(run.imagePath) / item, outDir))
+            {
+                metrics::add(metrics::ERRORS);
+                std::cerr << "Error: Cannot read " << item << std::endl;
+                return false;
+            }
+        }
+        catch (const std::exception &e)
+        {
+            metrics::add(metrics::ERRORS);
+            std::cerr << "Error: " << item << ": " << e.what() << std::endl;
+            return false;
+        }
+        log.markDone(item);
+        run.picNums += 1;
+        return true;
+    };
+
+    std::vector<std::string> manifest = job::loadOrBuildManifest(run.imagePath, (std::filesystem::path(jobDir) / "manifest.txt").string(), run.pattern);
+    std::string checkpointDir = (std::filesystem::path(jobDir) / "checkpoints").string();
+    std::cout << "Manifest has " << manifest.size() << " images" << std::endl;
+    if (cmd.exist("queue"))
+    {
+        const std::string id = job::workerId();
+        job::CheckpointLog log(checkpointDir, "worker-" + id);
+        job::DirectoryQueue queue((std::filesystem::path(jobDir) / "queue").string(), id);
+        queue.seed(manifest, (size_t)cmd.get<int>("chunk_size"));
+        std::vector<std::string> chunk, failed;
+        while (true)
+        {
+            queue.requeueStale(cmd.get<int>("claim_timeout"));
+            if (!queue.claim(chunk))
+                break;
+            failed.clear();
+            for (const std::string &item : chunk)
+            {
+                if (!processItem(item, log))
+                    failed.push_back(item);
+                queue.heartbeat();
+            }
+            // failed items go back to the queue, as a rerun of shard mode would retry them
+            queue.complete(failed);
+        }
+    }
+    else
+    {
+        job::CheckpointLog log(checkpointDir, "shard-" + std::to_string(shardIndex) + "-of-" + std::to_string(shardCount));
+        std::cout << "Shard " << shardIndex << "/" << shardCount << ", " << log.doneCount() << " items already done" << std::endl;
+        for (const std::string &item : manifest)
+        {
+            if (job::inShard(item, shardIndex, shardCount))
+                processItem(item, log);
+        }
+    }
+}
+
+// watch mode: arrival time of every file in flight, and what to do once it is saved
+class WatchedFiles
+{
+public:
+    explicit WatchedFiles(const std::string &doneDir) : doneDir(doneDir)
+    {
+        if (!doneDir.empty())
+            std::filesystem::create_directories(doneDir);
+    }
+
+    // false for a file already marked done, or still in flight (e.g. rewritten before it finished)
+    bool add(const std::string &path)
+    {
+        if (doneDir.empty() && std::filesystem::exists(path + ".done"))
+            return false;
+        std::lock_guard<std::mutex> lock(mutex);
+        return files.emplace(path, std::chrono::steady_clock::now()).second;
+    }
+
+    // a file that failed is left in place and dropped from the map, so dropping it
+    // again is picked up
+    void forget(const std::string &path)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        files.erase(path);
+    }
+
+    // moves the file to doneDir or marks it, once its results are saved
+    void complete(const std::string &path)
+    {
+        std::chrono::steady_clock::time_point arrival;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto found = files.find(path);
+            if (found == files.end())
+                return;
+            arrival = found->second;
+            files.erase(found);
+        }
+        std::error_code error;
+        if (!doneDir.empty())
+            std::filesystem::rename(path, std::filesystem::path(doneDir) / std::filesystem::path(path).filename(), error);
+        else
+            std::ofstream(path + ".done").close();
+        if (error)
+            std::cerr << "Error: Cannot move " << path << ": " << error.message() << std::endl;
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - arrival).count();
+        metrics::observe(metrics::STAGE_TOTAL, ms);
+        std::cout << path << " done " << ms << "ms after arrival" << std::endl;
+    }
+
+private:
+    const std::string doneDir;
+    std::map<std::string, std::chrono::steady_clock::time_point> files;
+    std::mutex mutex;
+};
+
+// decode, infer and encode stages over processFile's halves; with watched, files that
+// fail anywhere are forgotten and saved ones completed
+static std::unique_ptr<Pipeline> makePipeline(RunContext &run, std::vector<int> stageWorkers, WatchedFiles *watched)
+{
+    cmdline::parser &cmd = run.cmd;
+    PipelineConfig config;
+    stageWorkers.resize(3, 1);
+    config.decode.workers = stageWorkers[0];
+    config.infer.workers = stageWorkers[1];
+    config.encode.workers = stageWorkers[2];
+    std::vector<std::string> stageCpus = utils::split(cmd.get<std::string>("pin"), ';');
+    stageCpus.resize(3);
+    config.decode.cpus = utils::parseCpuList(stageCpus[0]);
+    config.infer.cpus = utils::parseCpuList(stageCpus[1]);
+    config.encode.cpus = utils::parseCpuList(stageCpus[2]);
+    config.maxInFlight = (size_t)cmd.get<int>("max_in_flight");
+    if (run.options.memoryBudget > 0 && !cmd.exist("max_in_flight"))
+        config.maxInFlight = 4;
+
+    auto forget = [watched](const PipelineFrame &frame)
+    {
+        if (watched)
+            watched->forget(frame.path);
+    };
+    return std::make_unique<Pipeline>(
+        config,
+        [&run, forget, watched](PipelineFrame &frame)
+        {
+            bool decoded = false;
+            try
+            {
+                decoded = decodeFile(run, frame);
+            }
+            catch (...)
+            {
+                forget(frame);
+                throw;
+            }
+            if (!decoded && watched)
+            {
+                std::cerr << "Error: Cannot read " << frame.path << std::endl;
+                forget(frame);
+            }
+            return decoded;
+        },
+        [&run, forget](PipelineFrame &frame)
+        {
+            try
+            {
+                inferFile(run, frame);
+            }
+            catch (...)
+            {
+                forget(frame);
+                throw;
+            }
+        },
+        [&run, forget, watched](PipelineFrame &frame)
+        {
+            try
+            {
+                finishFrame(run, frame.image, frame.results, std::filesystem::path(frame.path).filename().string(), run.savePath);
+                if (watched)
+                    watched->complete(frame.path);
+            }
+            catch (...)
+            {
+                forget(frame);
+                throw;
+            }
+        });
+}
+
+#ifdef __linux__
+// keeps feeding files written into imagePath to the pipeline until SIGINT or SIGTERM
+static void runWatch(RunContext &run, Pipeline &pipeline, WatchedFiles &watched)
+{
+    auto submit = [&](const std::string &path)
+    {
+        if (!std::regex_match(std::filesystem::path(path).filename().string(), run.pattern) || !watched.add(path))
+            return;
+        run.picNums += 1;
+        pipeline.submit(PipelineFrame{path, cv::Mat(), {}});
+    };
+
+    // watching starts before the scan, so a file dropped in between is not missed
+    FolderWatcher watcher(run.imagePath);
+    activeWatcher = &watcher;
+    std::signal(SIGINT, stopWatching);
+    std::signal(SIGTERM, stopWatching);
+    // files dropped while the daemon was down
+    for (const auto &entry : std::filesystem::directory_iterator(run.imagePath))
+    {
+        if (std::filesystem::is_regular_file(entry.path()))
+            submit(entry.path().string());
+    }
+    std::cout << "Watching " << run.imagePath << ", Ctrl-C to stop" << std::endl;
+
+    std::vector<std::string> arrived;
+    while (watcher.next(arrived, run.cmd.get<int>("watch_batch_ms"), 64))
+    {
+        for (const std::string &path : arrived)
+            submit(path);
+    }
+    activeWatcher = nullptr;
+    std::cout << "Stopping, finishing " << pipeline.inFlight() << " files in flight" << std::endl;
+}
+#endif
+
+// images directly in imagePath, in directory order
+static std::vector<std::filesystem::path> listImages(const RunContext &run)
+{
+    std::vector<std::filesystem::path> files;
+    for (const auto &entry : std::filesystem::directory_iterator(run.imagePath))
+    {
+        if (std::filesystem::is_regular_file(entry.path()) && std::regex_match(entry.path().filename().string(), run.pattern))
+            files.push_back(entry.path());
+    }
+    return files;
+}
+
+// small images are collected and packed onto shared canvases, one inference per canvas
+static void runMosaic(RunContext &run, int mosaicMaxSide)
+{
+    const cv::Size mosaicCanvas = run.options.inputSize.empty() ? cv::Size(640, 640) : run.options.inputSize;
+    const size_t mosaicBatch = 64;
+    std::vector<std::string> mosaicNames;
+    std::vector<cv::Mat> mosaicImages;
+    size_t mosaicRuns = 0, mosaicPacked = 0;
+    auto flushMosaic = [&]()
+    {
+        if (mosaicImages.empty())
+            return;
+        for (const mosaic::Mosaic &packed : mosaic::pack(mosaicImages, mosaicCanvas, run.cmd.get<int>("mosaic_gutter")))
+        {
+            cv::Mat canvas = packed.canvas;
+            std::vector<std::vector<Yolov8Result>> canvasResults = run.registry.predictAll(canvas);
+            std::vector<std::vector<std::vector<Yolov8Result>>> perModel;
+            for (const std::vector<Yolov8Result> &results : canvasResults)
+                perModel.push_back(mosaic::split(packed, results));
+            for (size_t t = 0; t < packed.tiles.size(); t++)
+            {
+                std::vector<std::vector<Yolov8Result>> results;
+                for (const auto &tiles : perModel)
+                    results.push_back(tiles[t]);
+                size_t source = packed.tiles[t].source;
+                finishFrame(run, mosaicImages[source], results, mosaicNames[source], run.savePath);
+            }
+            mosaicRuns++;
+            mosaicPacked += packed.tiles.size();
+        }
+        mosaicNames.clear();
+        mosaicImages.clear();
+    };
+
+    for (const std::filesystem::path &file : listImages(run))
+    {
+        run.picNums += 1;
+        cv::Mat image = cv::imread(file.string());
+        if (image.empty())
+            continue;
+        std::string baseName = file.filename().string();
+        if (std::max(image.cols, image.rows) > std::min(mosaicMaxSide, std::min(mosaicCanvas.width, mosaicCanvas.height)))
+        {
+            std::vector<std::vector<Yolov8Result>> results = run.registry.predictAll(image);
+            finishFrame(run, image, results, baseName, run.savePath);
+            continue;
+        }
+        mosaicNames.push_back(baseName);
+        mosaicImages.push_back(image);
+        if (mosaicImages.size() >= mosaicBatch)
+            flushMosaic();
+    }
+    flushMosaic();
+    if (mosaicRuns > 0)
+        std::cout << "Mosaic: " << mosaicPacked << " images in " << mosaicRuns << " runs, "
+                  << (double)mosaicPacked / mosaicRuns << " images per run" << std::endl;
+}
+
+// frames run batchSize at a time, bypassing the result cache
+static void runBatches(RunContext &run, int batchSize)
+{
+    std::vector<std::string> batchNames;
+    std::vector<cv::Mat> batchImages;
+    auto flushBatch = [&]()
+    {
+        if (batchImages.empty())
+            return;
+        metrics::ScopedTimer timer(metrics::STAGE_TOTAL);
+        std::vector<std::vector<std::vector<Yolov8Result>>> results = run.registry.predictAllBatch(batchImages);
+        for (size_t i = 0; i < batchImages.size(); i++)
+            finishFrame(run, batchImages[i], results[i], batchNames[i], run.savePath);
+        batchNames.clear();
+        batchImages.clear();
+    };
+
+    for (const std::filesystem::path &file : listImages(run))
+    {
+        run.picNums += 1;
+        cv::Mat image = cv::imread(file.string());
+        if (image.empty())
+            continue;
+        batchNames.push_back(file.filename().string());
+        batchImages.push_back(image);
+        if ((int)batchImages.size() >= batchSize)
+            flushBatch();
+    }
+    flushBatch();
+}
+
+// every image of the folder through the pipeline, or one by one without it
+static void runFolder(RunContext &run, const std::vector<int> &stageWorkers)
+{
+    if (stageWorkers.empty())
+    {
+        for (const std::filesystem::path &file : listImages(run))
+        {
+            run.picNums += 1;
+            // one bad file must not end the run
+            try
+            {
+                if (!processFile(run, file, run.savePath))
+                    std::cerr << "Error: Cannot read " << file.string() << std::endl;
+            }
+            catch (const std::exception &e)
+            {
+                metrics::add(metrics::ERRORS);
+                std::cerr << "Error: " << file.string() << ": " << e.what() << std::endl;
+            }
+        }
+        return;
+    }
+    std::unique_ptr<Pipeline> pipeline = makePipeline(run, stageWorkers, nullptr);
+    for (const std::filesystem::path &file : listImages(run))
+        pipeline->submit(PipelineFrame{file.string(), cv::Mat(), {}});
+    pipeline->finish();
+    run.picNums = (int)pipeline->completed();
+}
+
+static void printSummary(const RunContext &run, double totalTime)
+{
+    std::cout << "The total run time is: " << totalTime << "seconds" << std::endl;
+    std::cout << "The average run time is: " << totalTime / run.picNums << "seconds" << std::endl;
+    std::cout << "Throughput: " << run.picNums / totalTime << " frames/s" << std::endl;
+    if (run.options.resultCache)
+    {
+        ResultCache::Stats stats = run.options.resultCache->stats();
+        uint64_t lookups = stats.hits + stats.misses;
+        std::cout << "Result cache: " << stats.hits << " hits (" << stats.diskHits << " from disk), "
+                  << stats.misses << " misses, hit rate " << (lookups ? 100.0 * stats.hits / lookups : 0.0) << "%, "
+                  << stats.bytesSaved / 1024 << "KB saved, " << stats.entries << " entries in "
+                  << stats.memoryBytes / 1024 << "KB, " << stats.evictions << " evictions" << std::endl;
+    }
+
+    if (run.registry.hasScreener())
+    {
+        const cascade::Stats stats = run.registry.cascadeStats();
+        uint64_t runs = stats.fullRuns + stats.regionRuns;
+        std::cout << "Cascade: models ran on " << runs << " of " << stats.frames << " frames ("
+                  << (stats.frames ? 100.0 * runs / stats.frames : 0.0) << "%), " << stats.regionRuns << " on regions, "
+                  << (stats.framePixels ? 100.0 * stats.heavyPixels / stats.framePixels : 0.0) << "% of pixels" << std::endl;
+    }
+    const size_t memoryBudget = run.options.memoryBudget;
+    if (memoryBudget > 0 || run.cmd.exist("memory_stats"))
+    {
+        std::cout << metrics::memoryLine() << std::endl;
+        if (memoryBudget > 0 && metrics::peakResidentBytes() > memoryBudget)
+            std::cerr << "Warning: peak resident memory exceeded the " << (memoryBudget >> 20) << "MB budget" << std::endl;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    cmdline::parser cmd;
+    addFlags(cmd);
     cmd.parse_check(argc, argv);
 
-    bool isGPU = cmd.exist("gpu");
     const std::string classNamesPath = cmd.get<std::string>("class_names");
     const std::vector<std::string> classNames = utils::loadNames(classNamesPath);
     const std::string imagePath = cmd.get<std::string>("image_path");
@@ -34,75 +770,120 @@ int main(int argc, char *argv[])
     const std::string suffixName = cmd.get<std::string>("suffix_name");
     const std::string modelPath = cmd.get<std::string>("model_path");
 
+    // (suffix, model path) pairs, all run on each decoded frame
+    std::vector<std::pair<std::string, std::string>> models;
+    for (const std::string &spec : utils::split(cmd.get<std::string>("models"), ','))
+    {
+        size_t pos = spec.find(':');
+        if (pos == std::string::npos)
+        {
+            std::cerr << "Error: Invalid model spec (expected suffix:path): " << spec << std::endl;
+            return -1;
+        }
+        models.emplace_back(spec.substr(0, pos), spec.substr(pos + 1));
+    }
+    if (models.empty())
+        models.emplace_back(suffixName, modelPath);
+
     if (classNames.empty())
     {
         std::cerr << "Error: Empty class names file." << std::endl;
         return -1;
     }
-    if (!std::filesystem::exists(modelPath))
+    for (const auto &model : models)
     {
-        std::cerr << "Error: There is no model." << std::endl;
+        if (!std::filesystem::exists(model.second))
+        {
+            std::cerr << "Error: There is no model." << std::endl;
+            return -1;
+        }
+    }
+    const std::string shmName = cmd.get<std::string>("shm");
+    const std::string jobDir = cmd.get<std::string>("job_dir");
+    int shardIndex = 0, shardCount = 1;
+    if (!job::parseShard(cmd.get<std::string>("shard"), shardIndex, shardCount))
+    {
+        std::cerr << "Error: Invalid shard (expected i/N with i < N): " << cmd.get<std::string>("shard") << std::endl;
         return -1;
     }
-    if (!std::filesystem::is_directory(imagePath))
+    if (shmName.empty() && !std::filesystem::is_directory(imagePath))
     {
-        std::cerr << "Error: There is no model." << std::endl;
+        std::cerr << "Error: There is no image directory." << std::endl;
         return -1;
     }
     if (!std::filesystem::is_directory(savePath))
     {
         std::filesystem::create_directory(savePath);
     }
-    std::cout << "Model from :::" << modelPath << std::endl;
+    for (const auto &model : models)
+        std::cout << "Model from :::" << model.second << std::endl;
     std::cout << "Images from :::" << imagePath << std::endl;
     std::cout << "Resluts will be saved :::" << savePath << std::endl;
 
-    YOLOPredictor predictor{nullptr};
-    try
-    {
-        predictor = YOLOPredictor(modelPath, isGPU,
-                                  confThreshold,
-                                  iouThreshold,
-                                  maskThreshold);
-        std::cout << "Model was initialized." << std::endl;
-    }
-    catch (const std::exception &e)
-    {
-        std::cerr << e.what() << std::endl;
+    TunedSettings tuned;
+    if (!loadTunedSettings(cmd, tuned))
         return -1;
+    PredictorOptions options = predictorOptions(cmd, tuned);
+    metrics::trackMemory(options.memoryBudget > 0 || cmd.exist("memory_stats"));
+
+    // threads started from here on (ORT pools, pipeline workers) inherit the node's cpus,
+    // and first-touch places their memory on it; run one process per socket this way
+    if (cmd.get<int>("numa_node") >= 0)
+    {
+        std::vector<int> nodeCpus = utils::numaNodeCpus(cmd.get<int>("numa_node"));
+        if (!utils::pinThread(nodeCpus))
+        {
+            std::cerr << "Error: Cannot bind to NUMA node " << cmd.get<int>("numa_node") << std::endl;
+            return -1;
+        }
+        std::cout << "Bound to NUMA node " << cmd.get<int>("numa_node") << " (" << nodeCpus.size() << " cpus)" << std::endl;
     }
-    assert(classNames.size() == predictor.classNums);
-    std::regex pattern(".+\\.(jpg|jpeg|png|gif)$");
-    std::cout << "Start predicting..." << std::endl;
 
-    clock_t startTime, endTime;
-    startTime = clock();
+    // after the NUMA binding, so the pool's threads stay on the node too
+    if (cmd.get<int>("finalize_threads") > 0)
+        options.finalizePool = std::make_shared<WorkStealingPool>(cmd.get<int>("finalize_threads"));
 
-    int picNums = 0;
+    ModelRegistry registry(tuned.threads, 0, utils::parseCpuList(cmd.get<std::string>("ort_cpus")));
+    if (!loadModels(cmd, registry, models, options, classNames))
+        return -1;
 
-    for (const auto &entry : std::filesystem::directory_iterator(imagePath))
-    {
-        if (std::filesystem::is_regular_file(entry.path()) && std::regex_match(entry.path().filename().string(), pattern))
-        {
-            picNums += 1;
-            std::string Filename = entry.path().string();
-            std::string baseName = std::filesystem::path(Filename).filename().string();
-            std::cout << Filename << " predicting..." << std::endl;
+    RunContext run{cmd, registry, options, classNames, imagePath, savePath,
+                   std::regex(".+\\.(jpg|jpeg|png|gif)$"), !cmd.exist("no_save")};
+    std::cout << "Start predicting..." << std::endl;
 
-            cv::Mat image = cv::imread(Filename);
-            std::vector<Yolov8Result> result = predictor.predict(image);
-            utils::visualizeDetection(image, result, classNames);
+    if (cmd.get<int>("metrics_port") > 0)
+        metrics::serveHttp(cmd.get<int>("metrics_port"));
+    metrics::startReporter(cmd.get<int>("metrics_interval"));
 
-            std::string newFilename = baseName.substr(0, baseName.find_last_of('.')) + "_" + suffixName + baseName.substr(baseName.find_last_of('.'));
-            std::string outputFilename = savePath + "/" + newFilename;
-            cv::imwrite(outputFilename, image);
-            std::cout << outputFilename << " Saved !!!" << std::endl;
-        }
+    auto startTime = std::chrono::steady_clock::now();
+#ifdef __linux__
+    if (!shmName.empty())
+    {
+        if (!runSharedMemory(run, shmName, startTime))
+            return -1;
+    }
+    else
+#endif
+    if (!jobDir.empty())
+        runJob(run, jobDir, shardIndex, shardCount);
+#ifdef __linux__
+    else if (cmd.exist("watch"))
+    {
+        WatchedFiles watched(cmd.get<std::string>("done_dir"));
+        std::unique_ptr<Pipeline> pipeline = makePipeline(run, tuned.stageWorkers, &watched);
+        runWatch(run, *pipeline, watched);
+        pipeline->finish();
+        run.picNums = (int)pipeline->completed();
     }
-    endTime = clock();
-    std::cout << "The total run time is: " << (double)(endTime - startTime) / CLOCKS_PER_SEC << "seconds" << std::endl;
-    std::cout << "The average run time is: " << (double)(endTime - startTime) / picNums / CLOCKS_PER_SEC << "seconds" << std::endl;
+#endif
+    else if (cmd.get<int>("mosaic") > 0)
+        runMosaic(run, cmd.get<int>("mosaic"));
+    else if (tuned.stageWorkers.empty() && tuned.batchSize > 1)
+        runBatches(run, tuned.batchSize);
+    else
+        runFolder(run, tuned.stageWorkers);
 
+    printSummary(run, std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count());
     std::cout << "##########DONE################" << std::endl;
 
     return 0;
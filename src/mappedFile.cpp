@@ -0,0 +1,52 @@
+#include "mappedFile.h"
+
+#include <fstream>
+#include <iterator>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile(const std::string &path, bool populate)
+{
+#ifdef _WIN32
+    (void)populate;
+    std::ifstream file(path, std::ios::binary);
+    if (!file.good())
+        return;
+    buffer.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    bytes = buffer.data();
+    length = buffer.size();
+#else
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return;
+    struct stat st;
+    void *mapping = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size > 0)
+    {
+        int flags = MAP_PRIVATE;
+#ifdef MAP_POPULATE
+        if (populate)
+            flags |= MAP_POPULATE;
+#endif
+        mapping = mmap(nullptr, (size_t)st.st_size, PROT_READ, flags, fd, 0);
+    }
+    close(fd);
+    if (mapping == MAP_FAILED)
+        return;
+    bytes = (const char *)mapping;
+    length = (size_t)st.st_size;
+    mapped = true;
+#endif
+}
+
+MappedFile::~MappedFile()
+{
+#ifndef _WIN32
+    if (mapped)
+        munmap((void *)bytes, length);
+#endif
+}
@@ -0,0 +1,50 @@
+#include "maskProtos.h"
+
+#include <cmath>
+#include "utils.h"
+
+MaskProtos::MaskProtos(const float *data, int channels, int height, int width,
+                       const cv::Size &inputShape, const cv::Size &originalShape, float threshold,
+                       std::shared_ptr<const void> owner)
+    : data(data), channels(channels), height(height), width(width),
+      inputShape(inputShape), originalShape(originalShape), threshold(threshold), owner(std::move(owner))
+{
+    cv::Point pad;
+    float gain = utils::letterboxGain(inputShape, originalShape, pad);
+    // original image -> letterbox -> prototype coordinates
+    scaleX = gain * width / inputShape.width;
+    scaleY = gain * height / inputShape.height;
+    offsetX = (float)pad.x * width / inputShape.width;
+    offsetY = (float)pad.y * height / inputShape.height;
+}
+
+cv::Mat MaskProtos::boxMask(const float *coeffs, const cv::Rect &box, const cv::Size &size) const
+{
+    // cells under the box, and one more on each side for the interpolation
+    int x0 = std::max(0, (int)std::floor(box.x * scaleX + offsetX) - 1);
+    int y0 = std::max(0, (int)std::floor(box.y * scaleY + offsetY) - 1);
+    int x1 = std::min(width, (int)std::ceil((box.x + box.width) * scaleX + offsetX) + 1);
+    int y1 = std::min(height, (int)std::ceil((box.y + box.height) * scaleY + offsetY) + 1);
+    if (box.empty() || size.empty() || x1 <= x0 || y1 <= y0)
+        return cv::Mat::zeros(size, CV_8U);
+    cv::Rect cells(x0, y0, x1 - x0, y1 - y0);
+
+    cv::Mat logits = cv::Mat::zeros(cells.size(), CV_32F);
+    for (int c = 0; c < channels; c++)
+    {
+        cv::Mat plane(height, width, CV_32F, const_cast<float *>(data + (size_t)c * height * width));
+        cv::scaleAdd(plane(cells), coeffs[c], logits, logits);
+    }
+    cv::Mat sigmoid;
+    cv::exp(-logits, sigmoid);
+    sigmoid = 1.0 / (1.0 + sigmoid);
+
+    // the center of output pixel u covers box.x + (u + 0.5) * fx in the original image
+    float fx = (float)box.width / size.width;
+    float fy = (float)box.height / size.height;
+    cv::Matx23f toCells(fx * scaleX, 0, (box.x + 0.5f * fx) * scaleX + offsetX - 0.5f - x0,
+                        0, fy * scaleY, (box.y + 0.5f * fy) * scaleY + offsetY - 0.5f - y0);
+    cv::Mat mask;
+    cv::warpAffine(sigmoid, mask, toCells, size, cv::INTER_LINEAR | cv::WARP_INVERSE_MAP, cv::BORDER_REPLICATE);
+    return mask > threshold;
+}
@@ -0,0 +1,434 @@
+#include "metrics.h"
+
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <vector>
+#ifndef _WIN32
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+    const char *COUNTER_NAMES[metrics::COUNTER_COUNT] = {
+        "frames", "requests", "detections", "cache_hits", "cache_misses", "errors", "result_bytes"};
+    const char *STAGE_NAMES[metrics::STAGE_COUNT] = {
+        "decode", "preprocess", "inference", "postprocess", "total"};
+    const char *GAUGE_NAMES[metrics::GAUGE_COUNT] = {"queue_depth"};
+
+    // upper bounds in ms, the last bucket is +Inf
+    const double LATENCY_BOUNDS[] = {1, 2, 5, 10, 20, 50, 100, 200, 500, 1000, 2000};
+    const double DETECTION_BOUNDS[] = {0, 1, 2, 5, 10, 20, 50, 100, 300};
+    constexpr int LATENCY_BUCKETS = sizeof(LATENCY_BOUNDS) / sizeof(double) + 1;
+    constexpr int DETECTION_BUCKETS = sizeof(DETECTION_BOUNDS) / sizeof(double) + 1;
+
+    struct Histogram
+    {
+        std::vector<uint64_t> buckets;
+        uint64_t count = 0;
+        double sum = 0.0;
+    };
+
+    // written by its owning thread only, read by scrapes
+    struct alignas(64) Shard
+    {
+        std::atomic<uint64_t> counters[metrics::COUNTER_COUNT]{};
+        std::atomic<uint64_t> stageBuckets[metrics::STAGE_COUNT][LATENCY_BUCKETS]{};
+        std::atomic<uint64_t> stageSumUs[metrics::STAGE_COUNT]{};
+        std::atomic<uint64_t> detectionBuckets[DETECTION_BUCKETS]{};
+        std::atomic<uint64_t> detectionSum{0};
+    };
+
+    // shared by every thread, only written while memory tracking is on
+    std::atomic<bool> memoryTracking{false};
+    std::atomic<size_t> stagePeakResident[metrics::STAGE_COUNT]{};
+
+    // single writer, so a load and a store replace a locked read-modify-write
+    inline void bump(std::atomic<uint64_t> &value, uint64_t n)
+    {
+        value.store(value.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+
+    // adds every count of from to into; callers serialize writers of into
+    void merge(Shard &into, const Shard &from)
+    {
+        for (int c = 0; c < metrics::COUNTER_COUNT; c++)
+            bump(into.counters[c], from.counters[c].load(std::memory_order_relaxed));
+        for (int s = 0; s < metrics::STAGE_COUNT; s++)
+        {
+            for (int b = 0; b < LATENCY_BUCKETS; b++)
+                bump(into.stageBuckets[s][b], from.stageBuckets[s][b].load(std::memory_order_relaxed));
+            bump(into.stageSumUs[s], from.stageSumUs[s].load(std::memory_order_relaxed));
+        }
+        for (int b = 0; b < DETECTION_BUCKETS; b++)
+            bump(into.detectionBuckets[b], from.detectionBuckets[b].load(std::memory_order_relaxed));
+        bump(into.detectionSum, from.detectionSum.load(std::memory_order_relaxed));
+    }
+
+    struct Registry
+    {
+        std::mutex mutex;
+        // shards of live threads; a thread's counts move to retired when it exits
+        std::vector<Shard *> shards;
+        Shard retired;
+        std::function<int64_t()> gauges[metrics::GAUGE_COUNT];
+    };
+
+    Registry &registry()
+    {
+        static Registry *instance = new Registry;
+        return *instance;
+    }
+
+    // frees the thread's shard on exit, so a thread per connection does not leave one behind
+    struct ShardOwner
+    {
+        Shard *shard = nullptr;
+
+        ~ShardOwner()
+        {
+            if (!shard)
+                return;
+            Registry &r = registry();
+            std::lock_guard<std::mutex> lock(r.mutex);
+            merge(r.retired, *shard);
+            r.shards.erase(std::find(r.shards.begin(), r.shards.end(), shard));
+            delete shard;
+        }
+    };
+
+    Shard &localShard()
+    {
+        thread_local ShardOwner owner;
+        if (!owner.shard)
+        {
+            Registry &r = registry();
+            std::lock_guard<std::mutex> lock(r.mutex);
+            owner.shard = new Shard;
+            r.shards.push_back(owner.shard);
+        }
+        return *owner.shard;
+    }
+
+    int bucketOf(const double *bounds, int boundCount, double value)
+    {
+        int i = 0;
+        while (i < boundCount && value > bounds[i])
+            i++;
+        return i;
+    }
+
+    struct Totals
+    {
+        uint64_t counters[metrics::COUNTER_COUNT] = {};
+        Histogram stages[metrics::STAGE_COUNT];
+        Histogram detections;
+    };
+
+    Totals collect()
+    {
+        Totals totals;
+        for (Histogram &stage : totals.stages)
+            stage.buckets.assign(LATENCY_BUCKETS, 0);
+        totals.detections.buckets.assign(DETECTION_BUCKETS, 0);
+
+        Registry &r = registry();
+        std::lock_guard<std::mutex> lock(r.mutex);
+        std::vector<const Shard *> shards(r.shards.begin(), r.shards.end());
+        shards.push_back(&r.retired);
+        for (const Shard *shard : shards)
+        {
+            for (int c = 0; c < metrics::COUNTER_COUNT; c++)
+                totals.counters[c] += shard->counters[c].load(std::memory_order_relaxed);
+            for (int s = 0; s < metrics::STAGE_COUNT; s++)
+            {
+                for (int b = 0; b < LATENCY_BUCKETS; b++)
+                {
+                    uint64_t n = shard->stageBuckets[s][b].load(std::memory_order_relaxed);
+                    totals.stages[s].buckets[b] += n;
+                    totals.stages[s].count += n;
+                }
+                totals.stages[s].sum += shard->stageSumUs[s].load(std::memory_order_relaxed) / 1000.0;
+            }
+            for (int b = 0; b < DETECTION_BUCKETS; b++)
+            {
+                uint64_t n = shard->detectionBuckets[b].load(std::memory_order_relaxed);
+                totals.detections.buckets[b] += n;
+                totals.detections.count += n;
+            }
+            totals.detections.sum += (double)shard->detectionSum.load(std::memory_order_relaxed);
+        }
+        return totals;
+    }
+
+    void writeHistogram(std::ostringstream &out, const std::string &name, const std::string &labels,
+                        const Histogram &histogram, const double *bounds, int boundCount)
+    {
+        uint64_t cumulative = 0;
+        std::string prefix = labels.empty() ? "{" : "{" + labels + ",";
+        for (int b = 0; b < boundCount; b++)
+        {
+            cumulative += histogram.buckets[b];
+            out << name << "_bucket" << prefix << "le=\"" << bounds[b] << "\"} " << cumulative << "\n";
+        }
+        cumulative += histogram.buckets[boundCount];
+        out << name << "_bucket" << prefix << "le=\"+Inf\"} " << cumulative << "\n";
+        std::string suffix = labels.empty() ? "" : "{" + labels + "}";
+        out << name << "_sum" << suffix << " " << histogram.sum << "\n";
+        out << name << "_count" << suffix << " " << histogram.count << "\n";
+    }
+}
+
+void metrics::add(Counter counter, uint64_t n)
+{
+    bump(localShard().counters[counter], n);
+}
+
+void metrics::observe(Stage stage, double ms)
+{
+    Shard &shard = localShard();
+    bump(shard.stageBuckets[stage][bucketOf(LATENCY_BOUNDS, LATENCY_BUCKETS - 1, ms)], 1);
+    bump(shard.stageSumUs[stage], (uint64_t)(ms * 1000.0));
+    if (memoryTracking.load(std::memory_order_relaxed))
+    {
+        size_t resident = residentBytes();
+        size_t peak = stagePeakResident[stage].load(std::memory_order_relaxed);
+        while (resident > peak && !stagePeakResident[stage].compare_exchange_weak(peak, resident, std::memory_order_relaxed))
+        {
+        }
+    }
+}
+
+void metrics::observeDetections(size_t detections)
+{
+    Shard &shard = localShard();
+    bump(shard.detectionBuckets[bucketOf(DETECTION_BOUNDS, DETECTION_BUCKETS - 1, (double)detections)], 1);
+    bump(shard.detectionSum, detections);
+    bump(shard.counters[DETECTIONS], detections);
+}
+
+void metrics::setGaugeSource(Gauge gauge, std::function<int64_t()> source)
+{
+    Registry &r = registry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    r.gauges[gauge] = std::move(source);
+}
+
+size_t metrics::residentBytes()
+{
+#ifdef __linux__
+    std::ifstream statm("/proc/self/statm");
+    size_t pages = 0, resident = 0;
+    if (statm >> pages >> resident)
+        return resident * (size_t)sysconf(_SC_PAGESIZE);
+#endif
+    return 0;
+}
+
+size_t metrics::peakResidentBytes()
+{
+#ifdef __linux__
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status, line))
+    {
+        // "VmHWM:    123456 kB"
+        if (line.compare(0, 6, "VmHWM:") == 0)
+            return (size_t)std::stoull(line.substr(6)) * 1024;
+    }
+#endif
+    return 0;
+}
+
+void metrics::trackMemory(bool enable)
+{
+    memoryTracking = enable;
+}
+
+size_t metrics::stagePeakResidentBytes(Stage stage)
+{
+    return stagePeakResident[stage].load(std::memory_order_relaxed);
+}
+
+std::string metrics::memoryLine()
+{
+    Totals totals = collect();
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(1)
+        << "memory: peak " << peakResidentBytes() / (1024.0 * 1024.0) << "MB resident";
+    if (memoryTracking)
+    {
+        out << ", at stage end";
+        for (int s = 0; s < STAGE_COUNT; s++)
+            out << " " << STAGE_NAMES[s] << " " << stagePeakResident[s].load(std::memory_order_relaxed) / (1024.0 * 1024.0) << "MB";
+    }
+    out << ", " << (totals.counters[DETECTIONS] ? (double)totals.counters[RESULT_BYTES] / totals.counters[DETECTIONS] : 0.0)
+        << " bytes per result";
+    return out.str();
+}
+
+std::string metrics::prometheusText()
+{
+    Totals totals = collect();
+    std::ostringstream out;
+    for (int c = 0; c < COUNTER_COUNT; c++)
+    {
+        out << "# TYPE yolov8_" << COUNTER_NAMES[c] << "_total counter\n";
+        out << "yolov8_" << COUNTER_NAMES[c] << "_total " << totals.counters[c] << "\n";
+    }
+    out << "# TYPE yolov8_stage_latency_ms histogram\n";
+    for (int s = 0; s < STAGE_COUNT; s++)
+    {
+        writeHistogram(out, "yolov8_stage_latency_ms", std::string("stage=\"") + STAGE_NAMES[s] + "\"",
+                       totals.stages[s], LATENCY_BOUNDS, LATENCY_BUCKETS - 1);
+    }
+    out << "# TYPE yolov8_detections_per_frame histogram\n";
+    writeHistogram(out, "yolov8_detections_per_frame", "", totals.detections, DETECTION_BOUNDS, DETECTION_BUCKETS - 1);
+
+    std::function<int64_t()> gauges[GAUGE_COUNT];
+    {
+        Registry &r = registry();
+        std::lock_guard<std::mutex> lock(r.mutex);
+        for (int g = 0; g < GAUGE_COUNT; g++)
+            gauges[g] = r.gauges[g];
+    }
+    for (int g = 0; g < GAUGE_COUNT; g++)
+    {
+        if (!gauges[g])
+            continue;
+        out << "# TYPE yolov8_" << GAUGE_NAMES[g] << " gauge\n";
+        out << "yolov8_" << GAUGE_NAMES[g] << " " << gauges[g]() << "\n";
+    }
+    uint64_t lookups = totals.counters[CACHE_HITS] + totals.counters[CACHE_MISSES];
+    out << "# TYPE yolov8_cache_hit_ratio gauge\n";
+    out << "yolov8_cache_hit_ratio " << (lookups ? (double)totals.counters[CACHE_HITS] / lookups : 0.0) << "\n";
+    out << "# TYPE yolov8_resident_bytes gauge\n";
+    out << "yolov8_resident_bytes " << residentBytes() << "\n";
+    out << "# TYPE yolov8_peak_resident_bytes gauge\n";
+    out << "yolov8_peak_resident_bytes " << peakResidentBytes() << "\n";
+    if (memoryTracking)
+    {
+        out << "# TYPE yolov8_stage_peak_resident_bytes gauge\n";
+        for (int s = 0; s < STAGE_COUNT; s++)
+            out << "yolov8_stage_peak_resident_bytes{stage=\"" << STAGE_NAMES[s] << "\"} "
+                << stagePeakResident[s].load(std::memory_order_relaxed) << "\n";
+    }
+    return out.str();
+}
+
+std::string metrics::snapshotLine()
+{
+    static std::mutex mutex;
+    static Totals previous;
+    static std::chrono::steady_clock::time_point previousTime = std::chrono::steady_clock::now();
+    std::lock_guard<std::mutex> lock(mutex);
+
+    Totals totals = collect();
+    auto now = std::chrono::steady_clock::now();
+    double seconds = std::chrono::duration<double>(now - previousTime).count();
+    auto delta = [&](Counter c)
+    { return totals.counters[c] - previous.counters[c]; };
+    auto meanMs = [&](Stage s)
+    {
+        uint64_t count = totals.stages[s].count - (previous.stages[s].buckets.empty() ? 0 : previous.stages[s].count);
+        double sum = totals.stages[s].sum - (previous.stages[s].buckets.empty() ? 0.0 : previous.stages[s].sum);
+        return count ? sum / count : 0.0;
+    };
+
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(1)
+        << "metrics: " << (seconds > 0 ? delta(FRAMES) / seconds : 0.0) << " frames/s"
+        << ", " << (delta(FRAMES) ? (double)delta(DETECTIONS) / delta(FRAMES) : 0.0) << " det/frame"
+        << ", pre " << meanMs(STAGE_PREPROCESS) << "ms"
+        << ", infer " << meanMs(STAGE_INFERENCE) << "ms"
+        << ", post " << meanMs(STAGE_POSTPROCESS) << "ms"
+        << ", cache " << delta(CACHE_HITS) << "/" << delta(CACHE_HITS) + delta(CACHE_MISSES)
+        << ", errors " << delta(ERRORS)
+        << ", rss " << residentBytes() / (1024 * 1024) << "MB"
+        << " (peak " << peakResidentBytes() / (1024 * 1024) << "MB)";
+    previous = std::move(totals);
+    previousTime = now;
+    return out.str();
+}
+
+void metrics::startReporter(int intervalSeconds)
+{
+    if (intervalSeconds <= 0)
+        return;
+    snapshotLine();
+    std::thread([intervalSeconds]
+                {
+                    while (true)
+                    {
+                        std::this_thread::sleep_for(std::chrono::seconds(intervalSeconds));
+                        std::cout << snapshotLine() << std::endl;
+                    } })
+        .detach();
+}
+
+bool metrics::serveHttp(int port)
+{
+#ifdef _WIN32
+    std::cerr << "Metrics endpoint is not supported on Windows" << std::endl;
+    return false;
+#else
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0)
+        return false;
+    int reuse = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    // localhost only, scrapers reach it through the node's agent or a sidecar
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons((uint16_t)port);
+    if (bind(fd, (sockaddr *)&address, sizeof(address)) < 0 || listen(fd, 16) < 0)
+    {
+        std::cerr << "ERROR: cannot listen for metrics on port " << port << std::endl;
+        close(fd);
+        return false;
+    }
+
+    std::thread([fd]
+                {
+                    while (true)
+                    {
+                        int client = accept(fd, nullptr, nullptr);
+                        if (client < 0)
+                            continue;
+                        // a client that connects and sends nothing must not stall every later scrape
+                        timeval timeout{2, 0};
+                        setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+                        setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+                        char request[1024];
+                        ssize_t size = recv(client, request, sizeof(request) - 1, 0);
+                        std::string line(request, size > 0 ? (size_t)size : 0);
+                        bool found = line.rfind("GET /metrics", 0) == 0;
+                        std::string body = found ? prometheusText() : "not found\n";
+                        std::string response = std::string(found ? "HTTP/1.0 200 OK\r\n" : "HTTP/1.0 404 Not Found\r\n") +
+                                               "Content-Type: text/plain; version=0.0.4\r\n" +
+                                               "Content-Length: " + std::to_string(body.size()) + "\r\n\r\n" + body;
+                        size_t sent = 0;
+                        while (sent < response.size())
+                        {
+                            ssize_t n = send(client, response.data() + sent, response.size() - sent, MSG_NOSIGNAL);
+                            if (n <= 0)
+                                break;
+                            sent += (size_t)n;
+                        }
+                        close(client);
+                    } })
+        .detach();
+    std::cout << "Metrics on http://127.0.0.1:" << port << "/metrics" << std::endl;
+    return true;
+#endif
+}
@@ -0,0 +1,284 @@
+#include "modelRegistry.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <sstream>
+#include "metrics.h"
+
+ModelRegistry::ModelRegistry(int intraOpThreads, int interOpThreads, const std::vector<int> &intraOpCpus)
+{
+    Ort::ThreadingOptions threadingOptions;
+    if (!intraOpCpus.empty())
+    {
+        intraOpThreads = (int)intraOpCpus.size();
+        try
+        {
+            Ort::ThrowOnError(Ort::GetApi().SetGlobalIntraOpThreadAffinity(threadingOptions, utils::ortAffinity(intraOpCpus).c_str()));
+        }
+        catch (const std::exception &e)
+        {
+            std::cerr << "Warning: intra-op threads stay unpinned: " << e.what() << std::endl;
+        }
+    }
+    threadingOptions.SetGlobalIntraOpNumThreads(intraOpThreads);
+    threadingOptions.SetGlobalInterOpNumThreads(interOpThreads);
+    env = std::make_shared<Ort::Env>(threadingOptions, OrtLoggingLevel::ORT_LOGGING_LEVEL_WARNING, "YOLOV8");
+    prepackedWeights = std::make_shared<Ort::PrepackedWeightsContainer>();
+}
+
+YOLOPredictor &ModelRegistry::add(const std::string &name,
+                                  const std::string &modelPath,
+                                  const bool &isGPU,
+                                  float confThreshold,
+                                  float iouThreshold,
+                                  float maskThreshold,
+                                  PredictorOptions options)
+{
+    options.env = env;
+    options.globalThreadPool = true;
+    if (!options.prepackedWeights)
+        options.prepackedWeights = prepackedWeights;
+    if (options.arenaMaxBytes > 0 && !isGPU)
+        YOLOPredictor::registerArena(*env, options);
+    predictors.push_back(std::make_unique<YOLOPredictor>(modelPath, isGPU,
+                                                         confThreshold,
+                                                         iouThreshold,
+                                                         maskThreshold,
+                                                         options));
+    names.push_back(name);
+    this->options.push_back(options);
+
+    size_t source = predictors.size() - 1;
+    for (size_t i = 0; i + 1 < predictors.size(); i++)
+    {
+        if (predictors[i]->sharesPreprocessing(*predictors.back()))
+        {
+            source = i;
+            std::cout << name << " shares preprocessing with " << names[i] << std::endl;
+            break;
+        }
+    }
+    inputSource.push_back(source);
+    return *predictors.back();
+}
+
+YOLOPredictor &ModelRegistry::get(const std::string &name)
+{
+    for (size_t i = 0; i < names.size(); i++)
+    {
+        if (names[i] == name)
+            return *predictors[i];
+    }
+    throw std::out_of_range("No model named " + name);
+}
+
+YOLOPredictor &ModelRegistry::setScreener(const std::string &modelPath,
+                                          const bool &isGPU,
+                                          const cascade::Options &cascadeOptions,
+                                          PredictorOptions options)
+{
+    options.env = env;
+    options.globalThreadPool = true;
+    if (!options.prepackedWeights)
+        options.prepackedWeights = prepackedWeights;
+    // the screener's boxes only decide where to look, its masks are never used
+    options.lazyMasks = true;
+    screener = std::make_unique<YOLOPredictor>(modelPath, isGPU, cascadeOptions.screenConf, 0.5f, 0.5f, options);
+    screenOptions = cascadeOptions;
+
+    // a frame the screener rejects gets empty results, which only hold for this screener
+    std::stringstream config;
+    config << modelPath << "|" << std::filesystem::file_size(modelPath) << "|"
+           << std::filesystem::last_write_time(modelPath).time_since_epoch().count() << "|"
+           << options.inputSize.width << "x" << options.inputSize.height << "|"
+           << cascadeOptions.screenConf << "|" << cascadeOptions.regions << "|"
+           << cascadeOptions.regionMargin << "|" << cascadeOptions.maxRegionFraction << "|";
+    for (int classId : cascadeOptions.classes)
+        config << classId << ",";
+    std::string configString = config.str();
+    screenHash = utils::hashBytes(configString.data(), configString.size());
+    for (size_t i = 0; i < predictors.size(); i++)
+    {
+        if (screener->sharesPreprocessing(*predictors[i]))
+        {
+            std::cout << "Screener shares preprocessing with " << names[i] << std::endl;
+            break;
+        }
+    }
+    return *screener;
+}
+
+cv::Rect ModelRegistry::screen(cv::Mat &image, std::vector<LetterboxedInput> &inputs, std::vector<bool> &prepared)
+{
+    LetterboxedInput input;
+    screener->prepare(image, input);
+    cv::Rect region = cascade::region(screener->predict(input), image.size(), screenOptions);
+
+    const bool full = region.size() == image.size();
+    {
+        std::lock_guard<std::mutex> lock(screenMutex);
+        screenStats.frames++;
+        screenStats.framePixels += (uint64_t)image.total();
+        screenStats.heavyPixels += (uint64_t)region.area();
+        if (full)
+            screenStats.fullRuns++;
+        else if (!region.empty())
+            screenStats.regionRuns++;
+    }
+    if (full)
+    {
+        // the whole frame goes on, so the screener's tensor is as good as a model's own
+        for (size_t i = 0; i < predictors.size(); i++)
+        {
+            if (inputSource[i] == i && screener->sharesPreprocessing(*predictors[i]))
+            {
+                inputs[i] = std::move(input);
+                prepared[i] = true;
+                break;
+            }
+        }
+    }
+    return region;
+}
+
+cascade::Stats ModelRegistry::cascadeStats() const
+{
+    std::lock_guard<std::mutex> lock(screenMutex);
+    return screenStats;
+}
+
+void ModelRegistry::predictRegion(cv::Mat &image, std::vector<LetterboxedInput> &inputs, std::vector<bool> &prepared,
+                                  std::vector<std::vector<Yolov8Result>> &results, bool useCache)
+{
+    uint64_t contentHash = 0;
+    bool hashed = false;
+
+    for (size_t i = 0; i < predictors.size(); i++)
+    {
+        bool cached = useCache && options[i].resultCache;
+        if (cached)
+        {
+            if (!hashed)
+            {
+                contentHash = ResultCache::hashImage(image);
+                hashed = true;
+            }
+            if (predictors[i]->lookupCache(contentHash, results[i]))
+                continue;
+        }
+
+        size_t source = inputSource[i];
+        if (!prepared[source])
+        {
+            predictors[source]->prepare(image, inputs[source]);
+            prepared[source] = true;
+        }
+        results[i] = predictors[i]->predict(inputs[source]);
+        if (cached)
+            predictors[i]->storeCache(contentHash, results[i], image.total() * image.elemSize());
+    }
+}
+
+std::vector<std::vector<Yolov8Result>> ModelRegistry::predictAll(cv::Mat &image, bool useCache)
+{
+    std::vector<LetterboxedInput> inputs(predictors.size());
+    std::vector<bool> prepared(predictors.size(), false);
+    std::vector<std::vector<Yolov8Result>> results(predictors.size());
+    if (!screener)
+    {
+        predictRegion(image, inputs, prepared, results, useCache);
+        return results;
+    }
+
+    cv::Rect region = screen(image, inputs, prepared);
+    if (region.empty())
+        return results;
+    if (region.size() == image.size())
+    {
+        predictRegion(image, inputs, prepared, results, useCache);
+        return results;
+    }
+    // a view of the frame, letterboxing reads it without a copy
+    cv::Mat crop = image(region);
+    predictRegion(crop, inputs, prepared, results, useCache);
+    for (std::vector<Yolov8Result> &modelResults : results)
+        cascade::offsetResults(modelResults, region.tl());
+    return results;
+}
+
+std::vector<std::vector<std::vector<Yolov8Result>>> ModelRegistry::predictAllBatch(std::vector<cv::Mat> &images)
+{
+    std::vector<std::vector<std::vector<Yolov8Result>>> results(images.size(), std::vector<std::vector<Yolov8Result>>(predictors.size()));
+    // frames the screener passes whole are batched, crops of the others run one by one
+    std::vector<size_t> frames;
+    std::vector<cv::Mat> batch;
+    for (size_t i = 0; i < images.size(); i++)
+    {
+        if (!screener)
+        {
+            frames.push_back(i);
+            batch.push_back(images[i]);
+            continue;
+        }
+        std::vector<LetterboxedInput> inputs(predictors.size());
+        std::vector<bool> prepared(predictors.size(), false);
+        cv::Rect region = screen(images[i], inputs, prepared);
+        if (region.size() == images[i].size())
+        {
+            frames.push_back(i);
+            batch.push_back(images[i]);
+        }
+        else if (!region.empty())
+        {
+            cv::Mat crop = images[i](region);
+            predictRegion(crop, inputs, prepared, results[i]);
+            for (std::vector<Yolov8Result> &modelResults : results[i])
+                cascade::offsetResults(modelResults, region.tl());
+        }
+    }
+    if (batch.empty())
+        return results;
+
+    for (size_t m = 0; m < predictors.size(); m++)
+    {
+        std::vector<std::vector<Yolov8Result>> modelResults = predictors[m]->predictBatch(batch);
+        for (size_t b = 0; b < batch.size(); b++)
+            results[frames[b]][m] = std::move(modelResults[b]);
+    }
+    return results;
+}
+
+bool ModelRegistry::lookupAll(uint64_t contentHash, std::vector<std::vector<Yolov8Result>> &results, size_t inputBytes)
+{
+    results.assign(predictors.size(), std::vector<Yolov8Result>());
+    contentHash = cascadeKey(contentHash);
+    bool hit = true;
+    for (size_t i = 0; i < predictors.size() && hit; i++)
+        hit = predictors[i]->lookupCache(contentHash, results[i], false);
+
+    // a frame is only skipped when every model hits, so that is one hit, anything else one miss
+    std::vector<ResultCache *> caches;
+    for (const PredictorOptions &modelOptions : options)
+    {
+        ResultCache *cache = modelOptions.resultCache.get();
+        if (cache && std::find(caches.begin(), caches.end(), cache) == caches.end())
+        {
+            cache->countLookup(hit, inputBytes);
+            caches.push_back(cache);
+        }
+    }
+    metrics::add(hit ? metrics::CACHE_HITS : metrics::CACHE_MISSES);
+    return hit;
+}
+
+void ModelRegistry::storeAll(uint64_t contentHash, const std::vector<std::vector<Yolov8Result>> &results, size_t inputBytes)
+{
+    contentHash = cascadeKey(contentHash);
+    for (size_t i = 0; i < predictors.size() && i < results.size(); i++)
+        predictors[i]->storeCache(contentHash, results[i], inputBytes);
+}
+
+uint64_t ModelRegistry::cascadeKey(uint64_t contentHash) const
+{
+    return screener ? utils::hashBytes(&contentHash, sizeof(contentHash), screenHash) : contentHash;
+}
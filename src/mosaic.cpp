@@ -0,0 +1,108 @@
+#include "mosaic.h"
+
+#include <algorithm>
+#include <numeric>
+#include <stdexcept>
+
+namespace
+{
+    struct Shelf
+    {
+        int y;
+        int height;
+        int x; // next free column
+    };
+
+    struct Layout
+    {
+        std::vector<Shelf> shelves;
+        int nextY = 0; // top of the next shelf
+    };
+
+    bool place(Layout &layout, const cv::Size &size, const cv::Size &canvasSize, int gutter, cv::Point &at)
+    {
+        for (Shelf &shelf : layout.shelves)
+        {
+            if (size.height <= shelf.height && shelf.x + size.width <= canvasSize.width)
+            {
+                at = cv::Point(shelf.x, shelf.y);
+                shelf.x += size.width + gutter;
+                return true;
+            }
+        }
+        // images come tallest first, so the first image of a shelf sets its height
+        if (layout.nextY + size.height > canvasSize.height)
+            return false;
+        layout.shelves.push_back(Shelf{layout.nextY, size.height, size.width + gutter});
+        at = cv::Point(0, layout.nextY);
+        layout.nextY += size.height + gutter;
+        return true;
+    }
+}
+
+std::vector<mosaic::Mosaic> mosaic::pack(const std::vector<cv::Mat> &images, const cv::Size &canvasSize, int gutter)
+{
+    std::vector<size_t> order(images.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&images](size_t a, size_t b)
+                     { return images[a].rows > images[b].rows; });
+
+    std::vector<Mosaic> mosaics;
+    std::vector<Layout> layouts;
+    for (size_t index : order)
+    {
+        const cv::Mat &image = images[index];
+        if (image.cols > canvasSize.width || image.rows > canvasSize.height)
+            throw std::invalid_argument("Image larger than the mosaic canvas");
+
+        cv::Point at;
+        size_t target = 0;
+        while (target < layouts.size() && !place(layouts[target], image.size(), canvasSize, gutter, at))
+            target++;
+        if (target == layouts.size())
+        {
+            // the same gray as letterbox padding, so gutters look like padding to the model
+            mosaics.push_back(Mosaic{cv::Mat(canvasSize, CV_8UC3, cv::Scalar(114, 114, 114)), {}});
+            layouts.emplace_back();
+            place(layouts.back(), image.size(), canvasSize, gutter, at);
+        }
+        cv::Rect region(at, image.size());
+        image.copyTo(mosaics[target].canvas(region));
+        mosaics[target].tiles.push_back(Tile{index, region});
+    }
+    return mosaics;
+}
+
+std::vector<std::vector<Yolov8Result>> mosaic::split(const Mosaic &mosaic, const std::vector<Yolov8Result> &results)
+{
+    std::vector<std::vector<Yolov8Result>> perTile(mosaic.tiles.size());
+    for (const Yolov8Result &result : results)
+    {
+        cv::Point center(result.box.x + result.box.width / 2, result.box.y + result.box.height / 2);
+        for (size_t i = 0; i < mosaic.tiles.size(); i++)
+        {
+            const cv::Rect &region = mosaic.tiles[i].region;
+            if (!region.contains(center))
+                continue;
+
+            cv::Rect clipped = result.box & region;
+            Yolov8Result moved = result;
+            // lazy masks map canvas coordinates, so they are computed before the box moves
+            moved.materialize();
+            moved.box = clipped - region.tl();
+            if (!moved.boxMask.empty() && !clipped.empty())
+                moved.boxMask = moved.boxMask(clipped - result.box.tl());
+            for (std::vector<cv::Point> &contour : moved.contours)
+            {
+                for (cv::Point &point : contour)
+                {
+                    point.x = std::min(std::max(point.x, region.x), region.x + region.width - 1) - region.x;
+                    point.y = std::min(std::max(point.y, region.y), region.y + region.height - 1) - region.y;
+                }
+            }
+            perTile[i].push_back(moved);
+            break;
+        }
+    }
+    return perTile;
+}
@@ -0,0 +1,95 @@
+#include "pipeline.h"
+
+#include <iostream>
+
+Pipeline::Pipeline(const PipelineConfig &config, DecodeFn decode, StageFn infer, StageFn encode)
+    : config(config), decode(std::move(decode)), infer(std::move(infer)), encode(std::move(encode)),
+      decodeQueue(config.queueSize), inferQueue(config.queueSize), encodeQueue(config.queueSize)
+{
+    DecodeFn inferStep = [this](PipelineFrame &frame)
+    {
+        this->infer(frame);
+        return true;
+    };
+    DecodeFn encodeStep = [this](PipelineFrame &frame)
+    {
+        this->encode(frame);
+        return true;
+    };
+    for (int i = 0; i < std::max(1, config.decode.workers); i++)
+        decodeWorkers.emplace_back(&Pipeline::runStage, this, std::cref(this->config.decode), std::ref(decodeQueue), &inferQueue, this->decode);
+    for (int i = 0; i < std::max(1, config.infer.workers); i++)
+        inferWorkers.emplace_back(&Pipeline::runStage, this, std::cref(this->config.infer), std::ref(inferQueue), &encodeQueue, inferStep);
+    for (int i = 0; i < std::max(1, config.encode.workers); i++)
+        encodeWorkers.emplace_back(&Pipeline::runStage, this, std::cref(this->config.encode), std::ref(encodeQueue), nullptr, encodeStep);
+}
+
+Pipeline::~Pipeline()
+{
+    finish();
+}
+
+void Pipeline::submit(PipelineFrame frame)
+{
+    if (config.maxInFlight > 0)
+    {
+        std::unique_lock<std::mutex> lock(slotMutex);
+        slotFreed.wait(lock, [this]
+                       { return inFlight() < config.maxInFlight; });
+    }
+    submittedFrames++;
+    decodeQueue.push(std::make_unique<PipelineFrame>(std::move(frame)));
+}
+
+void Pipeline::finish()
+{
+    if (finished)
+        return;
+    finished = true;
+    // each stage drains before the next one is closed
+    decodeQueue.close();
+    for (std::thread &worker : decodeWorkers)
+        worker.join();
+    inferQueue.close();
+    for (std::thread &worker : inferWorkers)
+        worker.join();
+    encodeQueue.close();
+    for (std::thread &worker : encodeWorkers)
+        worker.join();
+}
+
+void Pipeline::runStage(const StageConfig &stage, BoundedQueue<FramePtr> &input, BoundedQueue<FramePtr> *output,
+                        const DecodeFn &work)
+{
+    if (!stage.cpus.empty() && !utils::pinThread(stage.cpus))
+        std::cerr << "Warning: could not pin a pipeline worker" << std::endl;
+
+    FramePtr frame;
+    while (input.pop(frame))
+    {
+        bool keep = false;
+        try
+        {
+            keep = work(*frame);
+        }
+        catch (const std::exception &e)
+        {
+            std::cerr << "Error: " << frame->path << ": " << e.what() << std::endl;
+        }
+        if (keep && output)
+        {
+            output->push(std::move(frame));
+            continue;
+        }
+        frame.reset();
+        {
+            // under the lock, so submit cannot miss the wakeup between its check and its wait
+            std::lock_guard<std::mutex> lock(slotMutex);
+            if (keep)
+                completedFrames++;
+            else
+                droppedFrames++;
+        }
+        slotFreed.notify_one();
+    }
+}
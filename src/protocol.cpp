@@ -0,0 +1,115 @@
+#include "protocol.h"
+
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+const char *protocol::statusName(int32_t status)
+{
+    switch (status)
+    {
+    case OK:
+        return "ok";
+    case BUSY:
+        return "busy";
+    case TIMEOUT:
+        return "timeout";
+    case BAD_REQUEST:
+        return "bad_request";
+    default:
+        return "unknown";
+    }
+}
+
+static bool makeAddress(const std::string &path, sockaddr_un &address)
+{
+    if (path.size() >= sizeof(address.sun_path))
+    {
+        std::cerr << "ERROR: Socket path too long: " << path << std::endl;
+        return false;
+    }
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    std::strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+    return true;
+}
+
+int protocol::listenUnix(const std::string &path, int backlog)
+{
+    sockaddr_un address;
+    if (!makeAddress(path, address))
+        return -1;
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+    {
+        std::cerr << "ERROR: socket: " << std::strerror(errno) << std::endl;
+        return -1;
+    }
+    // a stale socket file from a previous run would make bind fail
+    unlink(path.c_str());
+    if (bind(fd, (sockaddr *)&address, sizeof(address)) < 0 || listen(fd, backlog) < 0)
+    {
+        std::cerr << "ERROR: Failed to listen on " << path << ": " << std::strerror(errno) << std::endl;
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int protocol::connectUnix(const std::string &path)
+{
+    sockaddr_un address;
+    if (!makeAddress(path, address))
+        return -1;
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+    {
+        std::cerr << "ERROR: socket: " << std::strerror(errno) << std::endl;
+        return -1;
+    }
+    if (connect(fd, (sockaddr *)&address, sizeof(address)) < 0)
+    {
+        std::cerr << "ERROR: Failed to connect to " << path << ": " << std::strerror(errno) << std::endl;
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+bool protocol::sendAll(int fd, const void *data, size_t size)
+{
+    const char *ptr = (const char *)data;
+    while (size > 0)
+    {
+        // MSG_NOSIGNAL: a client that went away must not kill the server with SIGPIPE
+        ssize_t n = send(fd, ptr, size, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        ptr += n;
+        size -= (size_t)n;
+    }
+    return true;
+}
+
+bool protocol::recvAll(int fd, void *data, size_t size)
+{
+    char *ptr = (char *)data;
+    while (size > 0)
+    {
+        ssize_t n = recv(fd, ptr, size, 0);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        ptr += n;
+        size -= (size_t)n;
+    }
+    return true;
+}
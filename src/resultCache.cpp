@@ -0,0 +1,249 @@
+#include "resultCache.h"
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+
+#include "mappedFile.h"
+
+static const uint32_t CACHE_MAGIC = 0x59385243;
+
+// on-disk record: header, then per result a RecordResult and maskRows * maskCols mask bytes
+struct RecordHeader
+{
+    uint32_t magic;
+    uint32_t count;
+    uint64_t inputBytes;
+};
+
+struct RecordResult
+{
+    int32_t x, y, width, height;
+    float conf;
+    int32_t classId;
+    int32_t maskRows, maskCols;
+};
+
+ResultCache::ResultCache(size_t memoryBudget, const std::string &diskDir, size_t diskBudget)
+    : memoryBudget(memoryBudget), diskDir(diskDir), diskBudget(diskBudget)
+{
+    if (this->diskDir.empty())
+        return;
+    std::filesystem::create_directories(this->diskDir);
+    for (const auto &entry : std::filesystem::directory_iterator(this->diskDir))
+    {
+        if (entry.is_regular_file())
+            diskBytes += (size_t)entry.file_size();
+    }
+}
+
+uint64_t ResultCache::hashImage(const cv::Mat &image)
+{
+    int shape[3] = {image.rows, image.cols, image.type()};
+    uint64_t hash = utils::hashBytes(shape, sizeof(shape));
+    if (image.isContinuous())
+        return utils::hashBytes(image.data, image.total() * image.elemSize(), hash);
+    for (int row = 0; row < image.rows; row++)
+        hash = utils::hashBytes(image.ptr(row), image.cols * image.elemSize(), hash);
+    return hash;
+}
+
+bool ResultCache::get(uint64_t key, std::vector<Yolov8Result> &results, bool count)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = index.find(key);
+    if (it != index.end())
+    {
+        lru.splice(lru.begin(), lru, it->second);
+        results = it->second->results;
+        if (count)
+        {
+            counters.hits++;
+            counters.bytesSaved += it->second->inputBytes;
+        }
+        return true;
+    }
+
+    Entry entry;
+    if (readDisk(key, entry))
+    {
+        results = entry.results;
+        if (count)
+        {
+            counters.hits++;
+            counters.diskHits++;
+            counters.bytesSaved += entry.inputBytes;
+        }
+        insert(std::move(entry));
+        return true;
+    }
+    if (count)
+        counters.misses++;
+    return false;
+}
+
+void ResultCache::countLookup(bool hit, size_t inputBytes)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (hit)
+    {
+        counters.hits++;
+        counters.bytesSaved += inputBytes;
+    }
+    else
+        counters.misses++;
+}
+
+void ResultCache::put(uint64_t key, const std::vector<Yolov8Result> &results, size_t inputBytes)
+{
+    Entry entry{key, results, inputBytes, 0};
+    // callers own the masks they got back, the cache keeps its own copy; lazy masks are
+    // computed so an entry does not hold on to a frame's prototypes
+    for (Yolov8Result &result : entry.results)
+    {
+        if (result.protos)
+            result.materialize();
+        else
+            result.boxMask = result.boxMask.clone();
+    }
+    entry.bytes = utils::resultBytes(entry.results);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (index.count(key))
+        return;
+    writeDisk(entry);
+    insert(std::move(entry));
+}
+
+ResultCache::Stats ResultCache::stats() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return counters;
+}
+
+void ResultCache::insert(Entry entry)
+{
+    if (entry.bytes > memoryBudget)
+        return;
+    counters.memoryBytes += entry.bytes;
+    uint64_t key = entry.key;
+    lru.push_front(std::move(entry));
+    index[key] = lru.begin();
+
+    while (counters.memoryBytes > memoryBudget)
+    {
+        counters.memoryBytes -= lru.back().bytes;
+        index.erase(lru.back().key);
+        lru.pop_back();
+        counters.evictions++;
+    }
+    counters.entries = lru.size();
+}
+
+std::string ResultCache::diskPath(uint64_t key) const
+{
+    std::stringstream ss;
+    ss << diskDir << "/" << std::hex << key << ".bin";
+    return ss.str();
+}
+
+bool ResultCache::readDisk(uint64_t key, Entry &entry)
+{
+    if (diskDir.empty())
+        return false;
+    std::string path = diskPath(key);
+
+    MappedFile file(path);
+    const char *data = file.data();
+    size_t size = file.size();
+    if (file.empty())
+        return false;
+
+    bool ok = size >= sizeof(RecordHeader);
+    RecordHeader header{};
+    if (ok)
+    {
+        std::memcpy(&header, data, sizeof(header));
+        ok = header.magic == CACHE_MAGIC;
+    }
+    size_t offset = sizeof(RecordHeader);
+    for (uint32_t i = 0; ok && i < header.count; i++)
+    {
+        RecordResult record;
+        if (offset + sizeof(record) > size)
+        {
+            ok = false;
+            break;
+        }
+        std::memcpy(&record, data + offset, sizeof(record));
+        offset += sizeof(record);
+        size_t maskBytes = (size_t)record.maskRows * (size_t)record.maskCols;
+        if (offset + maskBytes > size)
+        {
+            ok = false;
+            break;
+        }
+
+        Yolov8Result result;
+        result.box = cv::Rect(record.x, record.y, record.width, record.height);
+        result.conf = record.conf;
+        result.classId = record.classId;
+        if (maskBytes > 0)
+            result.boxMask = cv::Mat(record.maskRows, record.maskCols, CV_8U, (void *)(data + offset)).clone();
+        offset += maskBytes;
+        entry.results.push_back(result);
+    }
+    if (!ok)
+        return false;
+
+    entry.key = key;
+    entry.inputBytes = (size_t)header.inputBytes;
+    entry.bytes = utils::resultBytes(entry.results);
+    return true;
+}
+
+void ResultCache::writeDisk(const Entry &entry)
+{
+    if (diskDir.empty())
+        return;
+
+    std::string path = diskPath(entry.key);
+    std::ofstream file(path, std::ios::binary);
+    RecordHeader header{CACHE_MAGIC, (uint32_t)entry.results.size(), (uint64_t)entry.inputBytes};
+    file.write((const char *)&header, sizeof(header));
+    size_t written = sizeof(header);
+    for (const Yolov8Result &result : entry.results)
+    {
+        // masks are stored as 8-bit box crops, the only kind postprocessing produces
+        cv::Mat mask = result.boxMask.isContinuous() ? result.boxMask : result.boxMask.clone();
+        RecordResult record{result.box.x, result.box.y, result.box.width, result.box.height,
+                            result.conf, result.classId, mask.rows, mask.cols};
+        file.write((const char *)&record, sizeof(record));
+        file.write((const char *)mask.data, (std::streamsize)mask.total());
+        written += sizeof(record) + mask.total();
+    }
+    file.close();
+    diskBytes += written;
+
+    if (diskBudget == 0 || diskBytes <= diskBudget)
+        return;
+    // over budget: drop the oldest files until 90% of the budget is left
+    std::vector<std::pair<std::filesystem::file_time_type, std::filesystem::path>> files;
+    for (const auto &item : std::filesystem::directory_iterator(diskDir))
+    {
+        if (item.is_regular_file())
+            files.emplace_back(item.last_write_time(), item.path());
+    }
+    std::sort(files.begin(), files.end());
+    for (const auto &file : files)
+    {
+        if (diskBytes <= diskBudget / 10 * 9)
+            break;
+        std::error_code error;
+        size_t fileSize = (size_t)std::filesystem::file_size(file.second, error);
+        if (!error && std::filesystem::remove(file.second, error))
+            diskBytes -= std::min(diskBytes, fileSize);
+    }
+}
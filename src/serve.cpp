@@ -0,0 +1,316 @@
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <future>
+#include <iostream>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "cmdline.h"
+#include "adaptiveResolution.h"
+#include "boundedQueue.h"
+#include "metrics.h"
+#include "protocol.h"
+#include "yolov8Predictor.h"
+
+typedef std::chrono::steady_clock Clock;
+
+struct Reply
+{
+    protocol::ResponseHeader header{protocol::MAGIC, protocol::OK, 0, 0.0f, 0.0f};
+    std::vector<protocol::Detection> detections;
+};
+
+struct Job
+{
+    std::vector<uchar> payload;
+    Clock::time_point arrival;
+    Clock::time_point deadline;
+    std::promise<Reply> reply;
+};
+
+struct ServerStats
+{
+    std::atomic<uint64_t> connections{0};
+    std::atomic<uint64_t> served{0};
+    std::atomic<uint64_t> shed{0};
+    std::atomic<uint64_t> timedOut{0};
+    std::atomic<uint64_t> failed{0};
+};
+
+static double elapsedMs(Clock::time_point from, Clock::time_point to)
+{
+    return std::chrono::duration<double, std::milli>(to - from).count();
+}
+
+static void runWorker(YOLOPredictor &predictor, BoundedQueue<std::shared_ptr<Job>> &queue, ServerStats &stats,
+                      ResolutionController *resolution)
+{
+    std::shared_ptr<Job> job;
+    while (queue.pop(job))
+    {
+        Clock::time_point start = Clock::now();
+        Reply reply;
+        reply.header.queueMs = (float)elapsedMs(job->arrival, start);
+
+        if (start > job->deadline)
+        {
+            // no point running a request whose client has already given up on it
+            reply.header.status = protocol::TIMEOUT;
+            stats.timedOut++;
+        }
+        else
+        {
+            try
+            {
+                cv::Mat image = cv::imdecode(job->payload, cv::IMREAD_COLOR);
+                metrics::observe(metrics::STAGE_DECODE, elapsedMs(start, Clock::now()));
+                if (image.empty())
+                {
+                    reply.header.status = protocol::BAD_REQUEST;
+                    stats.failed++;
+                    metrics::add(metrics::ERRORS);
+                }
+                else
+                {
+                    std::vector<Yolov8Result> results;
+                    if (resolution)
+                    {
+                        // the resolution is picked from the backlog this request leaves behind
+                        cv::Size size = resolution->select(queue.size());
+                        Clock::time_point inferStart = Clock::now();
+                        results = predictor.predict(image, size);
+                        resolution->record(size, elapsedMs(inferStart, Clock::now()));
+                    }
+                    else
+                        results = predictor.predict(image);
+                    for (const Yolov8Result &result : results)
+                    {
+                        reply.detections.push_back({result.box.x, result.box.y,
+                                                    result.box.width, result.box.height,
+                                                    result.conf, result.classId});
+                    }
+                    reply.header.count = (uint32_t)reply.detections.size();
+                    stats.served++;
+                    metrics::add(metrics::FRAMES);
+                }
+            }
+            catch (const std::exception &e)
+            {
+                std::cerr << "Request failed: " << e.what() << std::endl;
+                reply.header.status = protocol::BAD_REQUEST;
+                stats.failed++;
+                metrics::add(metrics::ERRORS);
+            }
+        }
+        reply.header.inferMs = (float)elapsedMs(start, Clock::now());
+        metrics::observe(metrics::STAGE_TOTAL, elapsedMs(job->arrival, Clock::now()));
+        job->reply.set_value(std::move(reply));
+    }
+}
+
+static void serveConnection(int fd, BoundedQueue<std::shared_ptr<Job>> &queue,
+                            uint32_t defaultDeadlineMs, ServerStats &stats)
+{
+    protocol::RequestHeader header;
+    while (protocol::recvAll(fd, &header, sizeof(header)))
+    {
+        if (header.magic != protocol::MAGIC || header.payloadSize > protocol::MAX_PAYLOAD)
+        {
+            std::cerr << "Closing connection: malformed request header" << std::endl;
+            break;
+        }
+
+        auto job = std::make_shared<Job>();
+        job->payload.resize(header.payloadSize);
+        if (!protocol::recvAll(fd, job->payload.data(), job->payload.size()))
+            break;
+        job->arrival = Clock::now();
+        metrics::add(metrics::REQUESTS);
+        uint32_t deadlineMs = header.deadlineMs ? header.deadlineMs : defaultDeadlineMs;
+        job->deadline = job->arrival + std::chrono::milliseconds(deadlineMs);
+
+        std::future<Reply> future = job->reply.get_future();
+        Reply reply;
+        // admission control: a full queue answers BUSY right away instead of queueing unbounded work
+        if (!queue.tryPush(job))
+        {
+            reply.header.status = protocol::BUSY;
+            stats.shed++;
+        }
+        else
+            reply = future.get();
+
+        if (!protocol::sendAll(fd, &reply.header, sizeof(reply.header)) ||
+            !protocol::sendAll(fd, reply.detections.data(), reply.detections.size() * sizeof(protocol::Detection)))
+            break;
+    }
+    close(fd);
+}
+
+int main(int argc, char *argv[])
+{
+    cmdline::parser cmd;
+    cmd.add<std::string>("model_path", 'm', "Path to onnx model.", false, "yolov8m.onnx");
+    cmd.add<std::string>("socket", 's', "Unix domain socket to listen on.", false, "/tmp/yolov8.sock");
+    cmd.add<int>("workers", 'w', "Concurrent inference requests.", false, 1);
+    cmd.add<int>("instances", '\0', "Predictor instances the workers are spread over, each with its own session.", false, 1);
+    cmd.add<std::string>("shared_weights", '\0', "Weights file from tools/split_weights.py, mapped once for all instances (-m must be the split model).", false, "");
+    cmd.add<int>("queue", 'q', "Requests waiting for a worker before new ones are shed.", false, 16);
+    cmd.add<int>("deadline_ms", 'd', "Default per-request deadline in milliseconds.", false, 1000);
+    cmd.add<int>("stats_interval", '\0', "Seconds between stats lines (0 disables).", false, 10);
+    cmd.add<int>("finalize_threads", '\0', "Finalize detections on a pool of this many threads shared by all workers (0 finalizes inline).", false, 0);
+    cmd.add<int>("memory_budget_mb", '\0', "Memory budget of the process in MB: ORT's arena, shared by all instances, is capped at half of it (0 disables).", false, 0);
+    cmd.add<int>("arena_max_mb", '\0', "Cap ORT's arena, shared by all instances, at this many MB (0 leaves it unbounded).", false, 0);
+    cmd.add<float>("conf", '\0', "Confidence threshold.", false, 0.4f);
+    cmd.add<float>("iou", '\0', "NMS IoU threshold.", false, 0.4f);
+    cmd.add<std::string>("adaptive", '\0', "Dynamic-shape models: input sizes to pick from per request, e.g. 320x320,480x480,640x640.", false, "");
+    cmd.add<int>("slo_ms", '\0', "Latency target of adaptive resolution in milliseconds (0 uses --deadline_ms).", false, 0);
+    cmd.add<int>("metrics_port", '\0', "Serve Prometheus metrics on this localhost port (0 disables).", false, 0);
+    cmd.add<int>("metrics_interval", '\0', "Seconds between metrics snapshot lines (0 disables).", false, 0);
+    cmd.add("gpu", '\0', "Inference on cuda device.");
+    cmd.parse_check(argc, argv);
+
+    const std::string modelPath = cmd.get<std::string>("model_path");
+    const std::string socketPath = cmd.get<std::string>("socket");
+    const int workerNums = std::max(1, cmd.get<int>("workers"));
+    const int instanceNums = std::max(1, std::min(workerNums, cmd.get<int>("instances")));
+    const uint32_t defaultDeadlineMs = (uint32_t)std::max(1, cmd.get<int>("deadline_ms"));
+    const int statsInterval = cmd.get<int>("stats_interval");
+
+    const std::vector<cv::Size> adaptiveSizes = utils::parseShapes(cmd.get<std::string>("adaptive"));
+    PredictorOptions options;
+    // every size adaptive mode may pick is warmed up front
+    options.warmupShapes = adaptiveSizes;
+    if (!adaptiveSizes.empty())
+        options.inputSize = *std::max_element(adaptiveSizes.begin(), adaptiveSizes.end(),
+                                              [](const cv::Size &a, const cv::Size &b)
+                                              { return a.area() < b.area(); });
+
+    const size_t memoryBudget = (size_t)cmd.get<int>("memory_budget_mb") << 20;
+    options.arenaMaxBytes = (size_t)cmd.get<int>("arena_max_mb") << 20;
+    if (memoryBudget > 0 && !cmd.exist("arena_max_mb"))
+        options.arenaMaxBytes = memoryBudget / 2;
+    options.arenaExtendSameAsRequested = options.arenaMaxBytes > 0;
+    // Ort::Env is one process-wide object, so the capped arena is registered on it once and
+    // every instance's session allocates from that one arena
+    if (options.arenaMaxBytes > 0 && !cmd.exist("gpu"))
+    {
+        options.env = std::make_shared<Ort::Env>(OrtLoggingLevel::ORT_LOGGING_LEVEL_WARNING, "YOLOV8");
+        YOLOPredictor::registerArena(*options.env, options);
+    }
+    // responses carry boxes only, masks are never computed
+    options.lazyMasks = true;
+    metrics::trackMemory(memoryBudget > 0);
+
+    if (cmd.get<int>("finalize_threads") > 0)
+        options.finalizePool = std::make_shared<WorkStealingPool>(cmd.get<int>("finalize_threads"));
+    // instances of one model keep their weights once; each still has its own session state
+    if (instanceNums > 1)
+        options.prepackedWeights = std::make_shared<Ort::PrepackedWeightsContainer>();
+
+    std::vector<std::unique_ptr<YOLOPredictor>> predictors;
+    std::unique_ptr<ResolutionController> resolution;
+    try
+    {
+        if (!cmd.get<std::string>("shared_weights").empty())
+        {
+            options.sharedWeights = std::make_shared<SharedWeights>(cmd.get<std::string>("shared_weights"));
+            std::cout << "Shared weights: " << options.sharedWeights->count() << " tensors, "
+                      << options.sharedWeights->bytes() / (1024 * 1024) << "MB" << std::endl;
+        }
+        // warmup runs in the constructor, so the first request does not pay for arena allocation
+        for (int i = 0; i < instanceNums; i++)
+            predictors.push_back(std::make_unique<YOLOPredictor>(modelPath, cmd.exist("gpu"),
+                                                                 cmd.get<float>("conf"),
+                                                                 cmd.get<float>("iou"),
+                                                                 0.5f,
+                                                                 options));
+        if (!adaptiveSizes.empty())
+        {
+            if (!predictors[0]->dynamicInputShape())
+                throw std::runtime_error("Adaptive resolution needs a model exported with dynamic input shape.");
+            double sloMs = cmd.get<int>("slo_ms") > 0 ? cmd.get<int>("slo_ms") : (double)defaultDeadlineMs;
+            resolution = std::make_unique<ResolutionController>(adaptiveSizes, sloMs, workerNums);
+            std::cout << "Adaptive resolution over " << adaptiveSizes.size() << " sizes, SLO " << sloMs << "ms" << std::endl;
+        }
+        std::cout << "Model was initialized." << std::endl;
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << e.what() << std::endl;
+        return -1;
+    }
+
+    int listenFd = protocol::listenUnix(socketPath, 128);
+    if (listenFd < 0)
+        return -1;
+
+    BoundedQueue<std::shared_ptr<Job>> queue((size_t)std::max(1, cmd.get<int>("queue")));
+    ServerStats stats;
+
+    metrics::setGaugeSource(metrics::QUEUE_DEPTH, [&queue]
+                            { return (int64_t)queue.size(); });
+    if (cmd.get<int>("metrics_port") > 0)
+        metrics::serveHttp(cmd.get<int>("metrics_port"));
+    metrics::startReporter(cmd.get<int>("metrics_interval"));
+
+    std::vector<std::thread> workers;
+    for (int i = 0; i < workerNums; i++)
+        workers.emplace_back(runWorker, std::ref(*predictors[i % instanceNums]), std::ref(queue), std::ref(stats), resolution.get());
+
+    if (statsInterval > 0)
+    {
+        std::thread([&queue, &stats, &resolution, statsInterval, memoryBudget]
+                    {
+                        while (true)
+                        {
+                            std::this_thread::sleep_for(std::chrono::seconds(statsInterval));
+                            std::cout << "connections " << stats.connections
+                                      << " served " << stats.served
+                                      << " shed " << stats.shed
+                                      << " timeout " << stats.timedOut
+                                      << " failed " << stats.failed
+                                      << " queue " << queue.size() << "/" << queue.maxSize();
+                            if (resolution)
+                            {
+                                // requests and current latency estimate per size
+                                std::vector<uint64_t> counts = resolution->counts();
+                                std::vector<double> latencies = resolution->latencies();
+                                for (size_t i = 0; i < counts.size(); i++)
+                                    std::cout << " " << resolution->sizes()[i].width << "x" << resolution->sizes()[i].height
+                                              << ":" << counts[i] << "@" << (int)latencies[i] << "ms";
+                            }
+                            if (memoryBudget > 0)
+                                std::cout << " " << metrics::memoryLine();
+                            std::cout << std::endl;
+                        } })
+            .detach();
+    }
+
+    std::cout << "Serving on " << socketPath << " with " << workerNums << " workers on " << instanceNums << " instances, queue "
+              << queue.maxSize() << ", deadline " << defaultDeadlineMs << "ms" << std::endl;
+    while (true)
+    {
+        int fd = accept(listenFd, nullptr, nullptr);
+        if (fd < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            std::cerr << "ERROR: accept failed" << std::endl;
+            break;
+        }
+        stats.connections++;
+        std::thread(serveConnection, fd, std::ref(queue), defaultDeadlineMs, std::ref(stats)).detach();
+    }
+
+    queue.close();
+    for (std::thread &worker : workers)
+        worker.join();
+    close(listenFd);
+    unlink(socketPath.c_str());
+    return 0;
+}
@@ -0,0 +1,53 @@
+#include "sharedWeights.h"
+
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+SharedWeights::SharedWeights(const std::string &weightsPath)
+    : file(std::make_unique<MappedFile>(weightsPath, true))
+{
+    if (file->empty())
+        throw std::runtime_error("Cannot map weights " + weightsPath);
+    std::ifstream index(weightsPath + ".idx");
+    if (!index)
+        throw std::runtime_error("Cannot read weights index " + weightsPath + ".idx");
+
+    Ort::MemoryInfo memoryInfo = Ort::MemoryInfo::CreateCpu(
+        OrtAllocatorType::OrtArenaAllocator, OrtMemType::OrtMemTypeDefault);
+    // one tensor per line: name, ONNX element type, comma separated dims (empty for scalars), offset, byte count
+    std::string line;
+    while (std::getline(index, line))
+    {
+        if (line.empty())
+            continue;
+        std::vector<std::string> fields;
+        std::stringstream lineStream(line);
+        std::string field;
+        while (std::getline(lineStream, field, '\t'))
+            fields.push_back(field);
+        if (fields.size() != 5)
+            throw std::runtime_error("Bad weights index line: " + line);
+
+        std::vector<int64_t> shape;
+        std::stringstream dims(fields[2]);
+        while (std::getline(dims, field, ','))
+            shape.push_back(std::stoll(field));
+        size_t offset = std::stoull(fields[3]);
+        size_t length = std::stoull(fields[4]);
+        if (offset + length > file->size())
+            throw std::runtime_error("Weights index points past the end of " + weightsPath + ": " + fields[0]);
+
+        names.push_back(fields[0]);
+        // ORT only reads initializers, the read-only mapping is never written through this pointer
+        values.push_back(Ort::Value::CreateTensor(memoryInfo, const_cast<char *>(file->data() + offset), length,
+                                                  shape.data(), shape.size(),
+                                                  (ONNXTensorElementDataType)std::stoi(fields[1])));
+        totalBytes += length;
+    }
+}
+
+void SharedWeights::addTo(Ort::SessionOptions &sessionOptions) const
+{
+    sessionOptions.AddExternalInitializers(names, values);
+}
@@ -0,0 +1,78 @@
+#include <chrono>
+#include <filesystem>
+#include <iostream>
+#include <regex>
+#include <thread>
+#include <opencv2/opencv.hpp>
+#include "cmdline.h"
+#include "shmRing.h"
+
+// Stand-in for a camera capture process: decodes the sample images once, then writes
+// them as raw BGR frames into the shared-memory ring for yolov8_ort --shm to consume.
+int main(int argc, char *argv[])
+{
+    cmdline::parser cmd;
+    cmd.add<std::string>("image_path", 'i', "Images to replay as frames.", false, "./Imginput");
+    cmd.add<std::string>("name", 'n', "Shared memory name.", false, "/yolov8_frames");
+    cmd.add<int>("slots", 's', "Frames in the ring.", false, 4);
+    cmd.add<int>("frames", 'f', "Frames to produce.", false, 500);
+    cmd.add<int>("fps", '\0', "Frames per second (0 produces as fast as the consumer allows).", false, 0);
+    cmd.parse_check(argc, argv);
+
+    const std::string imagePath = cmd.get<std::string>("image_path");
+    const int frameNums = cmd.get<int>("frames");
+    const int fps = cmd.get<int>("fps");
+
+    std::vector<cv::Mat> images;
+    cv::Size maxSize;
+    std::regex pattern(".+\\.(jpg|jpeg|png)$");
+    for (const auto &entry : std::filesystem::directory_iterator(imagePath))
+    {
+        if (!std::filesystem::is_regular_file(entry.path()) || !std::regex_match(entry.path().filename().string(), pattern))
+            continue;
+        cv::Mat image = cv::imread(entry.path().string());
+        if (image.empty())
+            continue;
+        maxSize.width = std::max(maxSize.width, image.cols);
+        maxSize.height = std::max(maxSize.height, image.rows);
+        images.push_back(image);
+    }
+    if (images.empty())
+    {
+        std::cerr << "Error: No images in " << imagePath << std::endl;
+        return -1;
+    }
+
+    try
+    {
+        ShmFrameRing ring(cmd.get<std::string>("name"), std::max(1, cmd.get<int>("slots")), maxSize);
+        std::cout << "Producing " << frameNums << " frames into " << cmd.get<std::string>("name")
+                  << " (" << ring.slotCount() << " slots of " << maxSize.width << "x" << maxSize.height << ")" << std::endl;
+
+        auto startTime = std::chrono::steady_clock::now();
+        for (int i = 0; i < frameNums; i++)
+        {
+            if (fps > 0)
+                std::this_thread::sleep_until(startTime + std::chrono::microseconds(1000000LL * i / fps));
+            const cv::Mat &image = images[i % images.size()];
+            // a real capture would write the sensor buffer here; this copy stands in for it
+            cv::Mat slot = ring.acquireWrite(image.size());
+            image.copyTo(slot);
+            ring.publish();
+        }
+        ring.close();
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+        std::cout << "Produced " << frameNums << " frames in " << seconds << "s ("
+                  << frameNums / seconds << " frames/s)" << std::endl;
+
+        // keep the segment alive until the consumer has released every frame
+        while (ring.pending() > 0)
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << e.what() << std::endl;
+        return -1;
+    }
+    return 0;
+}
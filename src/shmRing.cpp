@@ -0,0 +1,211 @@
+#include "shmRing.h"
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+static const uint32_t SHM_MAGIC = 0x59385348;
+static const size_t PAGE = 4096;
+
+struct ShmFrameRing::Header
+{
+    uint32_t magic;
+    uint32_t slots;
+    uint32_t maxWidth;
+    uint32_t maxHeight;
+    uint64_t slotStride;
+    // futex words: frames published by the producer and frames released by the consumer
+    std::atomic<uint32_t> writeSequence;
+    std::atomic<uint32_t> readSequence;
+    std::atomic<uint32_t> closed;
+};
+
+struct ShmFrameRing::SlotHeader
+{
+    uint32_t width;
+    uint32_t height;
+    uint64_t frameId;
+    uint8_t padding[48];
+    // BGR pixels follow, 64-byte aligned
+};
+
+static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t), "futex words must be plain 32-bit integers");
+
+static size_t roundUp(size_t value, size_t alignment)
+{
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+// shared (not FUTEX_PRIVATE) waits, the other side is a different process
+static void futexWait(std::atomic<uint32_t> &word, uint32_t expected, int timeoutMs)
+{
+    timespec timeout{timeoutMs / 1000, (long)(timeoutMs % 1000) * 1000000L};
+    syscall(SYS_futex, (uint32_t *)&word, FUTEX_WAIT, expected, timeoutMs < 0 ? nullptr : &timeout, nullptr, 0);
+}
+
+static void futexWake(std::atomic<uint32_t> &word)
+{
+    syscall(SYS_futex, (uint32_t *)&word, FUTEX_WAKE, INT32_MAX, nullptr, nullptr, 0);
+}
+
+ShmFrameRing::ShmFrameRing(const std::string &name, int slots, const cv::Size &maxSize)
+    : name(name), owner(true)
+{
+    size_t slotStride = roundUp(sizeof(SlotHeader) + (size_t)maxSize.width * maxSize.height * 3, PAGE);
+    size_t size = PAGE + slotStride * (size_t)slots;
+
+    int fd = shm_open(name.c_str(), O_CREAT | O_RDWR | O_TRUNC, 0600);
+    if (fd < 0)
+        throw std::runtime_error("shm_open " + name + ": " + std::strerror(errno));
+    if (ftruncate(fd, (off_t)size) < 0)
+    {
+        ::close(fd);
+        shm_unlink(name.c_str());
+        throw std::runtime_error("ftruncate " + name + ": " + std::strerror(errno));
+    }
+    map(fd, size);
+
+    header->slots = (uint32_t)slots;
+    header->maxWidth = (uint32_t)maxSize.width;
+    header->maxHeight = (uint32_t)maxSize.height;
+    header->slotStride = slotStride;
+    header->writeSequence.store(0);
+    header->readSequence.store(0);
+    header->closed.store(0);
+    // written last, a consumer that sees the magic sees a complete header
+    std::atomic_thread_fence(std::memory_order_release);
+    header->magic = SHM_MAGIC;
+}
+
+ShmFrameRing::ShmFrameRing(const std::string &name)
+    : name(name), owner(false)
+{
+    int fd = shm_open(name.c_str(), O_RDWR, 0600);
+    if (fd < 0)
+        throw std::runtime_error("shm_open " + name + ": " + std::strerror(errno));
+    struct stat st;
+    if (fstat(fd, &st) < 0 || (size_t)st.st_size < PAGE)
+    {
+        ::close(fd);
+        throw std::runtime_error("Shared memory " + name + " is not a frame ring");
+    }
+    map(fd, (size_t)st.st_size);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (header->magic != SHM_MAGIC)
+        throw std::runtime_error("Shared memory " + name + " is not a frame ring");
+}
+
+ShmFrameRing::~ShmFrameRing()
+{
+    if (mapping)
+        munmap(mapping, mappingSize);
+    if (owner)
+        shm_unlink(name.c_str());
+}
+
+void ShmFrameRing::map(int fd, size_t size)
+{
+    mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (mapping == MAP_FAILED)
+    {
+        mapping = nullptr;
+        throw std::runtime_error("mmap " + name + ": " + std::strerror(errno));
+    }
+    mappingSize = size;
+    header = (Header *)mapping;
+}
+
+ShmFrameRing::SlotHeader *ShmFrameRing::slot(uint32_t sequence) const
+{
+    size_t index = sequence % header->slots;
+    return (SlotHeader *)((char *)mapping + PAGE + index * header->slotStride);
+}
+
+cv::Mat ShmFrameRing::acquireWrite(const cv::Size &size, int timeoutMs)
+{
+    if ((uint32_t)size.width > header->maxWidth || (uint32_t)size.height > header->maxHeight)
+        return cv::Mat();
+
+    uint32_t write = header->writeSequence.load(std::memory_order_relaxed);
+    while (true)
+    {
+        uint32_t read = header->readSequence.load(std::memory_order_acquire);
+        if (write - read < header->slots)
+            break;
+        // ring full: sleep until the consumer releases a slot
+        futexWait(header->readSequence, read, timeoutMs);
+        if (timeoutMs >= 0 && write - header->readSequence.load(std::memory_order_acquire) >= header->slots)
+            return cv::Mat();
+    }
+
+    SlotHeader *s = slot(write);
+    s->width = (uint32_t)size.width;
+    s->height = (uint32_t)size.height;
+    s->frameId = write;
+    return cv::Mat(size, CV_8UC3, (char *)s + sizeof(SlotHeader));
+}
+
+void ShmFrameRing::publish()
+{
+    header->writeSequence.fetch_add(1, std::memory_order_release);
+    futexWake(header->writeSequence);
+}
+
+void ShmFrameRing::close()
+{
+    header->closed.store(1, std::memory_order_release);
+    // bump the futex word's waiters without publishing a frame
+    futexWake(header->writeSequence);
+}
+
+bool ShmFrameRing::acquireRead(cv::Mat &frame, uint64_t &frameId, int timeoutMs)
+{
+    uint32_t read = header->readSequence.load(std::memory_order_relaxed);
+    while (true)
+    {
+        uint32_t write = header->writeSequence.load(std::memory_order_acquire);
+        if (write != read)
+            break;
+        if (header->closed.load(std::memory_order_acquire))
+            return false;
+        // bounded slices: close() does not change writeSequence, so its wake could slip in
+        // between the closed check and the wait
+        futexWait(header->writeSequence, write, timeoutMs < 0 ? 100 : timeoutMs);
+        if (timeoutMs >= 0 && header->writeSequence.load(std::memory_order_acquire) == read)
+            return false;
+    }
+
+    SlotHeader *s = slot(read);
+    frameId = s->frameId;
+    frame = cv::Mat((int)s->height, (int)s->width, CV_8UC3, (char *)s + sizeof(SlotHeader));
+    return true;
+}
+
+void ShmFrameRing::release()
+{
+    header->readSequence.fetch_add(1, std::memory_order_release);
+    futexWake(header->readSequence);
+}
+
+int ShmFrameRing::slotCount() const
+{
+    return (int)header->slots;
+}
+
+int ShmFrameRing::pending() const
+{
+    return (int)(header->writeSequence.load(std::memory_order_acquire) -
+                 header->readSequence.load(std::memory_order_acquire));
+}
+
+cv::Size ShmFrameRing::maxFrameSize() const
+{
+    return cv::Size((int)header->maxWidth, (int)header->maxHeight);
+}
@@ -0,0 +1,344 @@
+#include <algorithm>
+#include <chrono>
+#include <ctime>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <opencv2/opencv.hpp>
+#include "cmdline.h"
+#include "modelRegistry.h"
+#include "pipeline.h"
+#include "tuneProfile.h"
+
+typedef std::chrono::steady_clock Clock;
+
+static double percentile(const std::vector<double> &sorted, double q)
+{
+    if (sorted.empty())
+        return 0.0;
+    size_t index = std::min(sorted.size() - 1, (size_t)(q * (double)sorted.size()));
+    return sorted[index];
+}
+
+static std::string describe(const TuneProfile &config)
+{
+    std::stringstream text;
+    text << "threads " << config.threads << ", batch " << config.batch << ", pipeline ";
+    if (config.pipeline.empty())
+        text << "off";
+    for (size_t i = 0; i < config.pipeline.size(); i++)
+        text << (i ? "," : "") << config.pipeline[i];
+    if (!config.inputSize.empty())
+        text << ", " << config.inputSize.width << "x" << config.inputSize.height;
+    return text.str();
+}
+
+// Searches intra-op threads, batch size, pipeline workers and (dynamic-shape models) input
+// size on sample images, one dimension at a time around the best configuration so far, and
+// writes the winner as a profile for yolov8_ort --profile or PredictorOptions::profilePath.
+// Every trial decodes, infers and encodes (draw + jpeg in memory) like a real run.
+int main(int argc, char *argv[])
+{
+    cmdline::parser cmd;
+    cmd.add<std::string>("model_path", 'm', "Path to onnx model.", false, "yolov8m.onnx");
+    cmd.add<std::string>("image_path", 'i', "Sample images.", false, "./Imginput");
+    cmd.add<std::string>("class_names", 'c', "Path to class names file.", false, "coco.names");
+    cmd.add<std::string>("output", 'o', "Profile to write.", false, "yolov8.profile");
+    cmd.add<double>("slo_ms", '\0', "Latency SLO on p95 per frame: best throughput within it.", false, 0.0);
+    cmd.add<double>("target_fps", '\0', "Throughput target: lowest p95 latency that reaches it.", false, 0.0);
+    cmd.add<std::string>("threads", '\0', "Intra-op thread counts to try (default powers of two up to the core count).", false, "");
+    cmd.add<std::string>("batches", '\0', "Batch sizes to try, dynamic-batch models only.", false, "1,2,4");
+    cmd.add<std::string>("pipelines", '\0', "Pipeline worker sets to try, 0 is no pipeline.", false, "0;1,1,1;2,1,2;2,2,2");
+    cmd.add<std::string>("sizes", '\0', "Input sizes to try, dynamic-shape models only; smaller sizes are picked only to meet a target.", false, "");
+    cmd.add<double>("seconds", '\0', "Duration of each trial.", false, 3.0);
+    cmd.add<int>("rounds", '\0', "Passes over all dimensions.", false, 2);
+    cmd.parse_check(argc, argv);
+
+    const std::string modelPath = cmd.get<std::string>("model_path");
+    const double sloMs = cmd.get<double>("slo_ms");
+    const double targetFps = cmd.get<double>("target_fps");
+    const double trialSeconds = std::max(0.5, cmd.get<double>("seconds"));
+
+    std::vector<std::vector<uchar>> samples;
+    for (const auto &entry : std::filesystem::directory_iterator(cmd.get<std::string>("image_path")))
+    {
+        std::ifstream in(entry.path(), std::ios::binary);
+        std::vector<uchar> bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        if (!cv::imdecode(bytes, cv::IMREAD_COLOR).empty())
+            samples.push_back(std::move(bytes));
+    }
+    if (samples.empty())
+    {
+        std::cerr << "Error: No readable images in " << cmd.get<std::string>("image_path") << std::endl;
+        return -1;
+    }
+    std::vector<std::string> classNames = utils::loadNames(cmd.get<std::string>("class_names"));
+
+    std::vector<int> threadCounts = utils::parseInts(cmd.get<std::string>("threads"));
+    if (threadCounts.empty())
+    {
+        int cores = (int)std::max(1u, std::thread::hardware_concurrency());
+        for (int n = 1; n < cores; n *= 2)
+            threadCounts.push_back(n);
+        threadCounts.push_back(cores);
+    }
+    std::vector<int> batchSizes = utils::parseInts(cmd.get<std::string>("batches"));
+    std::vector<std::vector<int>> pipelines;
+    for (const std::string &spec : utils::split(cmd.get<std::string>("pipelines"), ';'))
+    {
+        std::vector<int> workers = utils::parseInts(spec);
+        if (workers.size() == 1 && workers[0] == 0)
+            workers.clear();
+        workers.resize(workers.empty() ? 0 : 3, 1);
+        pipelines.push_back(workers);
+    }
+    std::vector<cv::Size> sizes = utils::parseShapes(cmd.get<std::string>("sizes"));
+    std::sort(sizes.begin(), sizes.end(), [](const cv::Size &a, const cv::Size &b)
+              { return a.area() > b.area(); });
+
+    // probe the model once for the dimensions it supports
+    bool dynamicBatch = false, dynamicShape = false;
+    try
+    {
+        PredictorOptions probeOptions;
+        probeOptions.warmup = false;
+        YOLOPredictor probe(modelPath, false, 0.4f, 0.4f, 0.5f, probeOptions);
+        dynamicBatch = probe.dynamicBatch();
+        dynamicShape = probe.dynamicInputShape();
+        if (classNames.empty())
+        {
+            for (int i = 0; i < probe.classNums; i++)
+                classNames.push_back(std::to_string(i));
+        }
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << e.what() << std::endl;
+        return -1;
+    }
+    if (!dynamicBatch)
+        batchSizes = {1};
+    if (!dynamicShape)
+        sizes.clear();
+    if (batchSizes.empty())
+        batchSizes = {1};
+    if (pipelines.empty())
+        pipelines.push_back({});
+
+    auto runTrial = [&](TuneProfile &config)
+    {
+        ModelRegistry registry(config.threads);
+        PredictorOptions options;
+        options.inputSize = config.inputSize;
+        options.warmupBatchSizes = config.batch > 1 ? std::vector<int>{1, config.batch} : std::vector<int>{1};
+        registry.add("tune", modelPath, false, 0.4f, 0.4f, 0.5f, options);
+
+        std::vector<double> latencies;
+        std::mutex latencyMutex;
+        size_t frames = 0;
+        Clock::time_point start = Clock::now();
+        Clock::time_point stop = start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(trialSeconds));
+        auto encode = [&classNames](cv::Mat &image, const std::vector<std::vector<Yolov8Result>> &results)
+        {
+            thread_local cv::Mat scratch;
+            std::vector<uchar> encoded;
+            utils::visualizeDetection(image, results[0], classNames, scratch);
+            cv::imencode(".jpg", image, encoded);
+        };
+
+        if (config.pipeline.empty())
+        {
+            size_t next = 0;
+            while (Clock::now() < stop)
+            {
+                Clock::time_point batchStart = Clock::now();
+                std::vector<cv::Mat> images;
+                for (int i = 0; i < config.batch; i++)
+                    images.push_back(cv::imdecode(samples[next++ % samples.size()], cv::IMREAD_COLOR));
+                std::vector<std::vector<std::vector<Yolov8Result>>> results = registry.predictAllBatch(images);
+                for (size_t i = 0; i < images.size(); i++)
+                    encode(images[i], results[i]);
+                // a frame is done when its whole batch is
+                double ms = std::chrono::duration<double, std::milli>(Clock::now() - batchStart).count();
+                latencies.insert(latencies.end(), images.size(), ms);
+                frames += images.size();
+            }
+        }
+        else
+        {
+            PipelineConfig pipelineConfig;
+            pipelineConfig.decode.workers = config.pipeline[0];
+            pipelineConfig.infer.workers = config.pipeline[1];
+            pipelineConfig.encode.workers = config.pipeline[2];
+            // frame paths carry the submit time, the encode stage turns it into a latency
+            std::vector<Clock::time_point> submitted;
+            std::mutex submittedMutex;
+            Pipeline pipeline(
+                pipelineConfig,
+                [&](PipelineFrame &frame)
+                {
+                    frame.image = cv::imdecode(samples[std::stoul(frame.path) % samples.size()], cv::IMREAD_COLOR);
+                    return !frame.image.empty();
+                },
+                [&](PipelineFrame &frame)
+                { frame.results = registry.predictAll(frame.image); },
+                [&](PipelineFrame &frame)
+                {
+                    encode(frame.image, frame.results);
+                    Clock::time_point submitTime;
+                    {
+                        std::lock_guard<std::mutex> lock(submittedMutex);
+                        submitTime = submitted[std::stoul(frame.path)];
+                    }
+                    std::lock_guard<std::mutex> lock(latencyMutex);
+                    latencies.push_back(std::chrono::duration<double, std::milli>(Clock::now() - submitTime).count());
+                });
+            for (size_t id = 0; Clock::now() < stop; id++)
+            {
+                {
+                    std::lock_guard<std::mutex> lock(submittedMutex);
+                    submitted.push_back(Clock::now());
+                }
+                pipeline.submit(PipelineFrame{std::to_string(id), cv::Mat(), {}});
+            }
+            pipeline.finish();
+            frames = pipeline.completed();
+        }
+
+        double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+        std::sort(latencies.begin(), latencies.end());
+        config.fps = frames / elapsed;
+        config.p50Ms = percentile(latencies, 0.50);
+        config.p95Ms = percentile(latencies, 0.95);
+        std::cout << describe(config) << ": " << config.fps << " fps, p50 " << config.p50Ms
+                  << "ms, p95 " << config.p95Ms << "ms" << std::endl;
+    };
+
+    auto meets = [&](const TuneProfile &config)
+    {
+        return (sloMs <= 0.0 || config.p95Ms <= sloMs) && (targetFps <= 0.0 || config.fps >= targetFps);
+    };
+    // true if a beats b under the objective
+    auto better = [&](const TuneProfile &a, const TuneProfile &b)
+    {
+        if (meets(a) != meets(b))
+            return meets(a);
+        if (!meets(a))
+            return sloMs > 0.0 ? a.p95Ms < b.p95Ms : a.fps > b.fps;
+        // smaller inputs cost accuracy, they only win when the larger ones miss the target
+        if (a.inputSize.area() != b.inputSize.area())
+            return a.inputSize.area() > b.inputSize.area();
+        if (targetFps > 0.0 && sloMs <= 0.0)
+            return a.p95Ms < b.p95Ms;
+        return a.fps > b.fps;
+    };
+
+    std::map<std::string, TuneProfile> measured;
+    auto measure = [&](TuneProfile config)
+    {
+        // pipeline stages run frames one at a time
+        if (!config.pipeline.empty())
+            config.batch = 1;
+        std::string key = describe(config);
+        auto found = measured.find(key);
+        if (found != measured.end())
+            return found->second;
+        try
+        {
+            runTrial(config);
+        }
+        catch (const std::exception &e)
+        {
+            std::cerr << describe(config) << ": " << e.what() << std::endl;
+            config.fps = 0.0;
+            config.p50Ms = config.p95Ms = 1e9;
+        }
+        measured[key] = config;
+        return config;
+    };
+
+    std::cout << "Tuning on " << samples.size() << " images, " << trialSeconds << "s per trial, objective: "
+              << (sloMs > 0.0 ? "throughput within p95 " + std::to_string(sloMs) + "ms"
+                              : targetFps > 0.0 ? "latency at " + std::to_string(targetFps) + " fps"
+                                                : std::string("throughput"))
+              << std::endl;
+
+    TuneProfile best;
+    best.threads = threadCounts.back();
+    best.inputSize = sizes.empty() ? cv::Size() : sizes.front();
+    best = measure(best);
+    for (int round = 0; round < std::max(1, cmd.get<int>("rounds")); round++)
+    {
+        std::string before = describe(best);
+        for (int dimension = 0; dimension < 4; dimension++)
+        {
+            std::vector<TuneProfile> candidates;
+            TuneProfile candidate = best;
+            if (dimension == 0)
+            {
+                for (int threads : threadCounts)
+                {
+                    candidate.threads = threads;
+                    candidates.push_back(candidate);
+                }
+            }
+            else if (dimension == 1 && best.pipeline.empty())
+            {
+                for (int batch : batchSizes)
+                {
+                    candidate.batch = batch;
+                    candidates.push_back(candidate);
+                }
+            }
+            else if (dimension == 2)
+            {
+                for (const std::vector<int> &workers : pipelines)
+                {
+                    candidate.pipeline = workers;
+                    candidates.push_back(candidate);
+                }
+            }
+            else if (dimension == 3 && (sloMs > 0.0 || targetFps > 0.0))
+            {
+                for (const cv::Size &size : sizes)
+                {
+                    candidate.inputSize = size;
+                    candidates.push_back(candidate);
+                }
+            }
+            for (const TuneProfile &config : candidates)
+            {
+                TuneProfile result = measure(config);
+                if (better(result, best))
+                    best = result;
+            }
+        }
+        if (describe(best) == before)
+            break;
+    }
+
+    if (!meets(best))
+        std::cout << "Warning: no configuration met the target, writing the closest one" << std::endl;
+    std::time_t now = std::time(nullptr);
+    char date[32];
+    std::strftime(date, sizeof(date), "%Y-%m-%d %H:%M", std::localtime(&now));
+    std::stringstream comment;
+    comment << "yolov8_tune " << date << ", " << std::filesystem::path(modelPath).filename().string()
+            << ", " << std::thread::hardware_concurrency() << " cpus, " << measured.size() << " trials";
+    try
+    {
+        best.save(cmd.get<std::string>("output"), comment.str());
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return -1;
+    }
+    std::cout << "Best: " << describe(best) << ": " << best.fps << " fps, p95 " << best.p95Ms << "ms" << std::endl;
+    std::cout << "Profile written to " << cmd.get<std::string>("output") << std::endl;
+    return 0;
+}
@@ -0,0 +1,87 @@
+#include "tuneProfile.h"
+
+#include <fstream>
+#include <stdexcept>
+
+static std::string trim(const std::string &str)
+{
+    size_t begin = str.find_first_not_of(" \t\r");
+    size_t end = str.find_last_not_of(" \t\r");
+    return begin == std::string::npos ? std::string() : str.substr(begin, end - begin + 1);
+}
+
+TuneProfile TuneProfile::load(const std::string &path)
+{
+    std::ifstream file(path);
+    if (!file)
+        throw std::runtime_error("Cannot read tuning profile " + path);
+
+    TuneProfile profile;
+    std::string line;
+    while (std::getline(file, line))
+    {
+        line = line.substr(0, line.find('#'));
+        size_t pos = line.find('=');
+        if (pos == std::string::npos)
+            continue;
+        std::string key = trim(line.substr(0, pos));
+        std::string value = trim(line.substr(pos + 1));
+        try
+        {
+            if (key == "threads")
+                profile.threads = std::stoi(value);
+            else if (key == "batch")
+                profile.batch = std::max(1, std::stoi(value));
+            else if (key == "pipeline")
+                profile.pipeline = utils::parseInts(value);
+            else if (key == "imgsz")
+            {
+                std::vector<cv::Size> sizes = utils::parseShapes(value);
+                profile.inputSize = sizes.empty() ? cv::Size() : sizes[0];
+            }
+            else if (key == "fps")
+                profile.fps = std::stod(value);
+            else if (key == "p50_ms")
+                profile.p50Ms = std::stod(value);
+            else if (key == "p95_ms")
+                profile.p95Ms = std::stod(value);
+        }
+        catch (const std::exception &)
+        {
+            throw std::runtime_error("Bad value in tuning profile " + path + ": " + line);
+        }
+    }
+    return profile;
+}
+
+void TuneProfile::save(const std::string &path, const std::string &comment) const
+{
+    std::ofstream file(path);
+    if (!file)
+        throw std::runtime_error("Cannot write tuning profile " + path);
+    if (!comment.empty())
+        file << "# " << comment << "\n";
+    file << "threads=" << threads << "\n";
+    file << "batch=" << batch << "\n";
+    file << "pipeline=";
+    for (size_t i = 0; i < pipeline.size(); i++)
+        file << (i ? "," : "") << pipeline[i];
+    file << "\n";
+    file << "imgsz=";
+    if (!inputSize.empty())
+        file << inputSize.width << "x" << inputSize.height;
+    file << "\n";
+    file << "# measured\n";
+    file << "fps=" << fps << "\n";
+    file << "p50_ms=" << p50Ms << "\n";
+    file << "p95_ms=" << p95Ms << "\n";
+}
+
+void TuneProfile::applyTo(PredictorOptions &options) const
+{
+    options.intraOpThreads = threads;
+    if (!inputSize.empty())
+        options.inputSize = inputSize;
+    if (batch > 1)
+        options.warmupBatchSizes = {1, batch};
+}
@@ -1,4 +1,13 @@
 #include "utils.h"
+#include "maskProtos.h"
+#include <climits>
+#include <cstring>
+#include <cstdio>
+#include <regex>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
 
 size_t utils::vectorProduct(const std::vector<int64_t> &vector)
 {
@@ -12,6 +21,92 @@ size_t utils::vectorProduct(const std::vector<int64_t> &vector)
     return product;
 }
 
+static inline uint64_t rotl64(uint64_t x, int r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+static const uint64_t PRIME64_1 = 0x9E3779B185EBCA87ULL;
+static const uint64_t PRIME64_2 = 0xC2B2AE3D27D4EB4FULL;
+static const uint64_t PRIME64_3 = 0x165667B19E3779F9ULL;
+static const uint64_t PRIME64_4 = 0x85EBCA77C2B2AE63ULL;
+static const uint64_t PRIME64_5 = 0x27D4EB2F165667C5ULL;
+
+static inline uint64_t xxhRound(uint64_t acc, uint64_t input)
+{
+    acc += input * PRIME64_2;
+    acc = rotl64(acc, 31);
+    return acc * PRIME64_1;
+}
+
+static inline uint64_t xxhMerge(uint64_t acc, uint64_t value)
+{
+    acc ^= xxhRound(0, value);
+    return acc * PRIME64_1 + PRIME64_4;
+}
+
+uint64_t utils::hashBytes(const void *data, size_t size, uint64_t seed)
+{
+    const uint8_t *p = (const uint8_t *)data;
+    const uint8_t *end = p + size;
+    uint64_t h;
+    uint64_t lane;
+    uint32_t word;
+
+    if (size >= 32)
+    {
+        uint64_t v1 = seed + PRIME64_1 + PRIME64_2;
+        uint64_t v2 = seed + PRIME64_2;
+        uint64_t v3 = seed;
+        uint64_t v4 = seed - PRIME64_1;
+        for (; p + 32 <= end; p += 32)
+        {
+            std::memcpy(&lane, p, 8);
+            v1 = xxhRound(v1, lane);
+            std::memcpy(&lane, p + 8, 8);
+            v2 = xxhRound(v2, lane);
+            std::memcpy(&lane, p + 16, 8);
+            v3 = xxhRound(v3, lane);
+            std::memcpy(&lane, p + 24, 8);
+            v4 = xxhRound(v4, lane);
+        }
+        h = rotl64(v1, 1) + rotl64(v2, 7) + rotl64(v3, 12) + rotl64(v4, 18);
+        h = xxhMerge(h, v1);
+        h = xxhMerge(h, v2);
+        h = xxhMerge(h, v3);
+        h = xxhMerge(h, v4);
+    }
+    else
+        h = seed + PRIME64_5;
+
+    h += (uint64_t)size;
+    for (; p + 8 <= end; p += 8)
+    {
+        std::memcpy(&lane, p, 8);
+        h ^= xxhRound(0, lane);
+        h = rotl64(h, 27) * PRIME64_1 + PRIME64_4;
+    }
+    if (p + 4 <= end)
+    {
+        std::memcpy(&word, p, 4);
+        h ^= (uint64_t)word * PRIME64_1;
+        h = rotl64(h, 23) * PRIME64_2 + PRIME64_3;
+        p += 4;
+    }
+    for (; p < end; p++)
+    {
+        h ^= (uint64_t)(*p) * PRIME64_5;
+        h = rotl64(h, 11) * PRIME64_1;
+    }
+
+    h ^= h >> 33;
+    h *= PRIME64_2;
+    h ^= h >> 29;
+    h *= PRIME64_3;
+    h ^= h >> 32;
+    return h;
+}
+
 std::wstring utils::charToWstring(const char *str)
 {
     typedef std::codecvt_utf8<wchar_t> convert_type;
@@ -40,45 +135,114 @@ std::vector<std::string> utils::loadNames(const std::string &path)
     {
         std::cerr << "ERROR: Failed to access class name path: " << path << std::endl;
     }
-    // set color
-    srand(time(0));
-
-    for (int i = 0; i < 2 * classNames.size(); i++)
-    {
-        int b = rand() % 256;
-        int g = rand() % 256;
-        int r = rand() % 256;
-        colors.push_back(cv::Scalar(b, g, r));
-    }
     return classNames;
 }
 
+const cv::Scalar &utils::classColor(int classId, bool forMask)
+{
+    // ultralytics palette in BGR, masks use the color half a palette away from their box
+    static const std::vector<cv::Scalar> palette = {
+        {56, 56, 255}, {151, 157, 255}, {31, 112, 255}, {29, 178, 255}, {49, 210, 207},
+        {10, 249, 72}, {23, 204, 146}, {134, 219, 61}, {52, 147, 26}, {187, 212, 0},
+        {168, 153, 44}, {255, 194, 0}, {147, 69, 52}, {255, 115, 100}, {236, 24, 0},
+        {255, 56, 132}, {133, 0, 82}, {255, 56, 203}, {200, 149, 255}, {199, 55, 255}};
+    int index = classId + (forMask ? (int)palette.size() / 2 : 0);
+    return palette[index % palette.size()];
+}
+
 void utils::visualizeDetection(cv::Mat &im, std::vector<Yolov8Result> &results,
                                const std::vector<std::string> &classNames)
 {
-    cv::Mat image = im.clone();
+    cv::Mat scratch;
+    visualizeDetection(im, results, classNames, scratch);
+}
+
+void utils::visualizeDetection(cv::Mat &im, const std::vector<Yolov8Result> &results,
+                               const std::vector<std::string> &classNames, cv::Mat &scratch)
+{
+    // pixels a detection can touch: its box (plus line width) and its label
+    std::vector<cv::Rect> regions;
+    std::vector<std::string> labels;
+    std::vector<cv::Size> labelSizes;
     for (const Yolov8Result &result : results)
     {
-
-        int x = result.box.x;
-        int y = result.box.y;
-
         int conf = (int)std::round(result.conf * 100);
-        int classId = result.classId;
-        std::string label = classNames[classId] + " 0." + std::to_string(conf);
+        std::string label = classNames[result.classId] + " 0." + std::to_string(conf);
 
         int baseline = 0;
         cv::Size size = cv::getTextSize(label, cv::FONT_ITALIC, 0.4, 1, &baseline);
-        image(result.box).setTo(colors[classId + classNames.size()], result.boxMask);
-        cv::rectangle(image, result.box, colors[classId], 2);
-        cv::rectangle(image,
-                      cv::Point(x, y), cv::Point(x + size.width, y + 12),
-                      colors[classId], -1);
-        cv::putText(image, label,
-                    cv::Point(x, y - 3 + 12), cv::FONT_ITALIC,
-                    0.4, cv::Scalar(0, 0, 0), 1);
+        cv::Rect labelRect(result.box.x - 2, result.box.y - 2,
+                           size.width + 4, std::max(12, size.height + baseline) + 4);
+        cv::Rect boxRect(result.box.x - 2, result.box.y - 2, result.box.width + 4, result.box.height + 4);
+        regions.push_back((boxRect | labelRect) & cv::Rect(0, 0, im.cols, im.rows));
+        labels.push_back(label);
+        labelSizes.push_back(size);
+    }
+
+    // merge overlapping regions so every pixel is blended once, like a single full-frame pass
+    std::vector<int> owner(results.size());
+    for (size_t i = 0; i < owner.size(); i++)
+        owner[i] = (int)i;
+    bool merged = true;
+    while (merged)
+    {
+        merged = false;
+        for (size_t i = 0; i < regions.size(); i++)
+        {
+            if (owner[i] != (int)i)
+                continue;
+            for (size_t j = i + 1; j < regions.size(); j++)
+            {
+                if (owner[j] != (int)j || (regions[i] & regions[j]).empty())
+                    continue;
+                regions[i] |= regions[j];
+                for (int &o : owner)
+                {
+                    if (o == (int)j)
+                        o = (int)i;
+                }
+                merged = true;
+            }
+        }
+    }
+
+    for (size_t r = 0; r < regions.size(); r++)
+    {
+        const cv::Rect &region = regions[r];
+        if (owner[r] != (int)r || region.empty())
+            continue;
+
+        if (scratch.rows < region.height || scratch.cols < region.width || scratch.type() != im.type())
+            scratch.create(std::max(scratch.rows, region.height), std::max(scratch.cols, region.width), im.type());
+        cv::Mat canvas = scratch(cv::Rect(0, 0, region.width, region.height));
+        cv::Mat roi = im(region);
+        roi.copyTo(canvas);
+
+        for (size_t i = 0; i < results.size(); i++)
+        {
+            if (owner[i] != (int)r)
+                continue;
+            const Yolov8Result &result = results[i];
+            cv::Rect box(result.box.x - region.x, result.box.y - region.y, result.box.width, result.box.height);
+            int x = box.x;
+            int y = box.y;
+
+            cv::Mat mask = result.mask();
+            if (!mask.empty() && mask.size() == box.size())
+                canvas(box).setTo(classColor(result.classId, true), mask);
+            if (!result.contours.empty())
+                cv::drawContours(canvas, result.contours, -1, classColor(result.classId), 1, cv::LINE_8,
+                                 cv::noArray(), INT_MAX, -region.tl());
+            cv::rectangle(canvas, box, classColor(result.classId), 2);
+            cv::rectangle(canvas,
+                          cv::Point(x, y), cv::Point(x + labelSizes[i].width, y + 12),
+                          classColor(result.classId), -1);
+            cv::putText(canvas, labels[i],
+                        cv::Point(x, y - 3 + 12), cv::FONT_ITALIC,
+                        0.4, cv::Scalar(0, 0, 0), 1);
+        }
+        cv::addWeighted(roi, 0.4, canvas, 0.6, 0, roi);
     }
-    cv::addWeighted(im, 0.4, image, 0.6, 0, im);
 }
 
 void utils::letterbox(const cv::Mat &image, cv::Mat &outImage,
@@ -120,10 +284,14 @@ void utils::letterbox(const cv::Mat &image, cv::Mat &outImage,
     dw /= 2.0f;
     dh /= 2.0f;
 
-    if (shape.width != newUnpad[0] && shape.height != newUnpad[1])
+    if (shape.width != newUnpad[0] || shape.height != newUnpad[1])
     {
         cv::resize(image, outImage, cv::Size(newUnpad[0], newUnpad[1]));
     }
+    else
+    {
+        outImage = image;
+    }
 
     int top = int(std::round(dh - 0.1f));
     int bottom = int(std::round(dh + 0.1f));
@@ -132,33 +300,258 @@ void utils::letterbox(const cv::Mat &image, cv::Mat &outImage,
     cv::copyMakeBorder(outImage, outImage, top, bottom, left, right, cv::BORDER_CONSTANT, color);
 }
 
-void utils::scaleCoords(cv::Rect &coords,
-                        cv::Mat &mask,
-                        const float maskThreshold,
-                        const cv::Size &imageShape,
-                        const cv::Size &imageOriginalShape)
+float utils::letterboxGain(const cv::Size &imageShape, const cv::Size &imageOriginalShape, cv::Point &pad)
 {
     float gain = std::min((float)imageShape.height / (float)imageOriginalShape.height,
                           (float)imageShape.width / (float)imageOriginalShape.width);
 
-    int pad[2] = {(int)(((float)imageShape.width - (float)imageOriginalShape.width * gain) / 2.0f),
-                  (int)(((float)imageShape.height - (float)imageOriginalShape.height * gain) / 2.0f)};
+    pad = cv::Point((int)(((float)imageShape.width - (float)imageOriginalShape.width * gain) / 2.0f),
+                    (int)(((float)imageShape.height - (float)imageOriginalShape.height * gain) / 2.0f));
+    return gain;
+}
+
+void utils::scaleBox(cv::Rect &coords, const cv::Size &imageShape, const cv::Size &imageOriginalShape)
+{
+    cv::Point pad;
+    float gain = letterboxGain(imageShape, imageOriginalShape, pad);
 
-    coords.x = (int)std::round(((float)(coords.x - pad[0]) / gain));
+    coords.x = (int)std::round(((float)(coords.x - pad.x) / gain));
     coords.x = std::max(0, coords.x);
-    coords.y = (int)std::round(((float)(coords.y - pad[1]) / gain));
+    coords.y = (int)std::round(((float)(coords.y - pad.y) / gain));
     coords.y = std::max(0, coords.y);
 
     coords.width = (int)std::round(((float)coords.width / gain));
     coords.width = std::min(coords.width, imageOriginalShape.width - coords.x);
     coords.height = (int)std::round(((float)coords.height / gain));
     coords.height = std::min(coords.height, imageOriginalShape.height - coords.y);
-    mask = mask(cv::Rect(pad[0], pad[1], imageShape.width - 2 * pad[0], imageShape.height - 2 * pad[1]));
+}
+
+void utils::scaleCoords(cv::Rect &coords,
+                        cv::Mat &mask,
+                        const float maskThreshold,
+                        const cv::Size &imageShape,
+                        const cv::Size &imageOriginalShape)
+{
+    cv::Point pad;
+    letterboxGain(imageShape, imageOriginalShape, pad);
+    scaleBox(coords, imageShape, imageOriginalShape);
+    mask = mask(cv::Rect(pad.x, pad.y, imageShape.width - 2 * pad.x, imageShape.height - 2 * pad.y));
 
     cv::resize(mask, mask, imageOriginalShape, cv::INTER_LINEAR);
 
     mask = mask(coords) > maskThreshold;
 }
+
+size_t utils::resultBytes(const std::vector<Yolov8Result> &results)
+{
+    size_t bytes = 0;
+    // lazy results of a frame share its prototypes, they are counted once
+    const MaskProtos *counted = nullptr;
+    for (const Yolov8Result &result : results)
+    {
+        bytes += sizeof(Yolov8Result) + result.boxMask.total() * result.boxMask.elemSize();
+        for (const std::vector<cv::Point> &contour : result.contours)
+            bytes += sizeof(contour) + contour.size() * sizeof(cv::Point);
+        bytes += result.maskCoeffs.size() * sizeof(float);
+        if (result.protos && result.protos.get() != counted)
+        {
+            counted = result.protos.get();
+            bytes += counted->bytes();
+        }
+    }
+    return bytes;
+}
+
+cv::Mat Yolov8Result::mask(double scale) const
+{
+    cv::Size size((int)std::round(box.width * scale), (int)std::round(box.height * scale));
+    // nothing to cover; an empty Mat is also what drawing code checks for
+    if (size.empty())
+        return cv::Mat();
+    if (protos)
+        return protos->boxMask(maskCoeffs.data(), box, size);
+    if (boxMask.empty() || scale == 1.0)
+        return boxMask;
+    cv::Mat scaled;
+    cv::resize(boxMask, scaled, size, 0, 0, cv::INTER_NEAREST);
+    return scaled;
+}
+
+cv::Mat Yolov8Result::imageMask(const cv::Size &imageShape, double scale) const
+{
+    cv::Mat image = cv::Mat::zeros(cv::Size((int)std::round(imageShape.width * scale), (int)std::round(imageShape.height * scale)), CV_8U);
+    cv::Rect target((int)std::round(box.x * scale), (int)std::round(box.y * scale),
+                    (int)std::round(box.width * scale), (int)std::round(box.height * scale));
+    target &= cv::Rect(0, 0, image.cols, image.rows);
+    if (target.empty() || (!protos && boxMask.empty()))
+        return image;
+
+    cv::Mat placed;
+    if (protos)
+        placed = protos->boxMask(maskCoeffs.data(), box, target.size());
+    else
+        cv::resize(boxMask, placed, target.size(), 0, 0, cv::INTER_NEAREST);
+    placed.copyTo(image(target));
+    return image;
+}
+
+void Yolov8Result::materialize()
+{
+    if (!protos)
+        return;
+    boxMask = mask();
+    protos.reset();
+    maskCoeffs.clear();
+    maskCoeffs.shrink_to_fit();
+}
+
+std::vector<cv::Size> utils::makeShapeBuckets(const cv::Size &maxShape, int step)
+{
+    std::vector<cv::Size> buckets;
+    if (step <= 0)
+        return buckets;
+
+    for (int h = step; h <= maxShape.height; h += step)
+        buckets.emplace_back(maxShape.width, h);
+    for (int w = step; w < maxShape.width; w += step)
+        buckets.emplace_back(w, maxShape.height);
+    return buckets;
+}
+
+bool utils::selectShapeBucket(const cv::Size &shape, const std::vector<cv::Size> &buckets, cv::Size &bucket)
+{
+    bool found = false;
+    for (const cv::Size &candidate : buckets)
+    {
+        if (candidate.width < shape.width || candidate.height < shape.height)
+            continue;
+        if (candidate.width != shape.width && candidate.height != shape.height)
+            continue;
+        if (!found || candidate.area() < bucket.area())
+        {
+            bucket = candidate;
+            found = true;
+        }
+    }
+    return found;
+}
+
+std::vector<std::string> utils::split(const std::string &str, char delimiter)
+{
+    std::vector<std::string> items;
+    std::stringstream ss(str);
+    std::string item;
+    while (getline(ss, item, delimiter))
+    {
+        if (!item.empty())
+            items.push_back(item);
+    }
+    return items;
+}
+
+std::vector<cv::Size> utils::parseShapes(const std::string &str)
+{
+    std::vector<cv::Size> shapes;
+    for (const std::string &item : split(str, ','))
+    {
+        size_t pos = item.find('x');
+        if (pos == std::string::npos)
+        {
+            std::cerr << "ERROR: Invalid shape (expected WxH): " << item << std::endl;
+            continue;
+        }
+        shapes.emplace_back(std::stoi(item.substr(0, pos)), std::stoi(item.substr(pos + 1)));
+    }
+    return shapes;
+}
+
+std::vector<int> utils::parseInts(const std::string &str)
+{
+    std::vector<int> values;
+    for (const std::string &item : split(str, ','))
+        values.push_back(std::stoi(item));
+    return values;
+}
+
+void utils::printStartupProfile(const std::string &profilePath)
+{
+    std::ifstream file(profilePath);
+    std::string json((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    file.close();
+    std::remove(profilePath.c_str());
+
+    // events look like {"cat" : "Session", ..., "dur" : 1234, ..., "name" : "session_initialization", ...}
+    std::regex event("\\{[^{}]*\"dur\"\\s*:\\s*(\\d+)[^{}]*\"name\"\\s*:\\s*\"(model_loading_\\w+|session_initialization)\"");
+    double parseMs = -1.0, initializeMs = -1.0;
+    for (std::sregex_iterator it(json.begin(), json.end(), event), end; it != end; ++it)
+    {
+        double ms = std::stod((*it)[1].str()) / 1000.0;
+        if ((*it)[2].str() == "session_initialization")
+            initializeMs = ms;
+        else
+            parseMs = ms;
+    }
+    if (parseMs < 0 && initializeMs < 0)
+    {
+        std::cout << "No startup events in " << profilePath << std::endl;
+        return;
+    }
+    std::cout << "ORT profile: parse " << parseMs << "ms, initialize (optimize, allocate initializers) "
+              << initializeMs << "ms" << std::endl;
+}
+
+std::vector<int> utils::parseCpuList(const std::string &str)
+{
+    std::vector<int> cpus;
+    for (const std::string &item : split(str, ','))
+    {
+        size_t dash = item.find('-');
+        int first = std::stoi(item.substr(0, dash));
+        int last = dash == std::string::npos ? first : std::stoi(item.substr(dash + 1));
+        for (int cpu = first; cpu <= last; cpu++)
+            cpus.push_back(cpu);
+    }
+    return cpus;
+}
+
+std::vector<int> utils::numaNodeCpus(int node)
+{
+    std::ifstream file("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+    std::string line;
+    if (!std::getline(file, line))
+        return {};
+    return parseCpuList(line);
+}
+
+bool utils::pinThread(const std::vector<int> &cpus)
+{
+#ifdef __linux__
+    if (cpus.empty())
+        return false;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : cpus)
+        CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+    (void)cpus;
+    return false;
+#endif
+}
+
+std::string utils::ortAffinity(const std::vector<int> &cpus)
+{
+    // ORT pins intra-op threads 1..n-1 one entry each (1-based logical processors); thread 0 is the caller
+    std::string affinity;
+    for (size_t i = 1; i < cpus.size(); i++)
+    {
+        if (!affinity.empty())
+            affinity += ";";
+        affinity += std::to_string(cpus[i] + 1);
+    }
+    return affinity;
+}
+
 template <typename T>
 T utils::clip(const T &n, const T &lower, const T &upper)
 {
@@ -0,0 +1,160 @@
+#include "workPool.h"
+
+#include <exception>
+#include <iostream>
+
+#include "utils.h"
+
+namespace
+{
+    // pool and deque of the calling thread when it is a pool worker
+    thread_local const WorkStealingPool *currentPool = nullptr;
+    thread_local size_t currentDeque = 0;
+}
+
+WorkStealingPool::WorkStealingPool(int threads, const std::vector<int> &cpus)
+{
+    threads = std::max(1, threads);
+    for (int i = 0; i < threads; i++)
+        deques.push_back(std::make_unique<TaskDeque>());
+    for (int i = 0; i < threads; i++)
+        workers.emplace_back(&WorkStealingPool::run, this, (size_t)i, cpus);
+}
+
+WorkStealingPool::~WorkStealingPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (std::thread &worker : workers)
+        worker.join();
+}
+
+void WorkStealingPool::submit(std::function<void()> task)
+{
+    size_t index = currentPool == this ? currentDeque : nextDeque++ % deques.size();
+    {
+        std::lock_guard<std::mutex> lock(deques[index]->mutex);
+        deques[index]->tasks.push_back(std::move(task));
+    }
+    {
+        // taken so a worker between its last empty check and wait() cannot miss the wakeup
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        queued++;
+    }
+    wake.notify_one();
+}
+
+bool WorkStealingPool::popTask(size_t index, std::function<void()> &task)
+{
+    // own deque newest first, its data is most likely still in cache
+    {
+        std::lock_guard<std::mutex> lock(deques[index]->mutex);
+        if (!deques[index]->tasks.empty())
+        {
+            task = std::move(deques[index]->tasks.back());
+            deques[index]->tasks.pop_back();
+            queued--;
+            return true;
+        }
+    }
+    for (size_t offset = 1; offset < deques.size(); offset++)
+    {
+        TaskDeque &victim = *deques[(index + offset) % deques.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty())
+        {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            queued--;
+            return true;
+        }
+    }
+    return false;
+}
+
+void WorkStealingPool::run(size_t index, const std::vector<int> &cpus)
+{
+    currentPool = this;
+    currentDeque = index;
+    if (!cpus.empty() && !utils::pinThread({cpus[index % cpus.size()]}))
+        std::cerr << "Warning: could not pin a pool worker" << std::endl;
+
+    std::function<void()> task;
+    while (true)
+    {
+        if (popTask(index, task))
+        {
+            task();
+            task = nullptr;
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        wake.wait(lock, [this]
+                  { return stopping || queued > 0; });
+        if (stopping && queued == 0)
+            return;
+    }
+}
+
+void WorkStealingPool::parallelFor(size_t count, const std::function<void(size_t)> &fn)
+{
+    if (count == 0)
+        return;
+    // indices are handed out from one counter, so helpers that start late find nothing
+    // left and finish at once; only claimed indices touch fn
+    struct State
+    {
+        std::atomic<size_t> next{0};
+        size_t count = 0;
+        const std::function<void(size_t)> *fn = nullptr;
+        std::mutex mutex;
+        std::condition_variable finished;
+        size_t done = 0;
+        std::exception_ptr error;
+    };
+    auto state = std::make_shared<State>();
+    state->count = count;
+    state->fn = &fn;
+
+    auto work = [state]
+    {
+        size_t index;
+        size_t ran = 0;
+        std::exception_ptr error;
+        while ((index = state->next++) < state->count)
+        {
+            try
+            {
+                (*state->fn)(index);
+            }
+            catch (...)
+            {
+                if (!error)
+                    error = std::current_exception();
+            }
+            ran++;
+        }
+        if (ran == 0)
+            return;
+        std::lock_guard<std::mutex> lock(state->mutex);
+        if (error && !state->error)
+            state->error = error;
+        state->done += ran;
+        if (state->done == state->count)
+            state->finished.notify_all();
+    };
+
+    size_t helpers = std::min(count - 1, workers.size());
+    for (size_t i = 0; i < helpers; i++)
+        submit(work);
+    work();
+
+    std::unique_lock<std::mutex> lock(state->mutex);
+    state->finished.wait(lock, [&state]
+                         { return state->done == state->count; });
+    if (state->error)
+        std::rethrow_exception(state->error);
+}
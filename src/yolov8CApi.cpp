@@ -0,0 +1,192 @@
+#include "yolov8CApi.h"
+
+#include <cmath>
+#include <cstring>
+#include <string>
+
+#include "yolov8Predictor.h"
+
+struct yolov8_predictor
+{
+    YOLOPredictor predictor{nullptr};
+    // results of the last detect, kept for yolov8_mask
+    std::vector<Yolov8Result> results;
+    cv::Size imageSize;
+};
+
+static thread_local std::string lastError;
+
+void yolov8_default_config(yolov8_config *config)
+{
+    config->use_gpu = 0;
+    config->conf_threshold = 0.4f;
+    config->iou_threshold = 0.4f;
+    config->mask_threshold = 0.5f;
+    config->intra_op_threads = 0;
+    config->top_k = 0;
+    config->warmup = 1;
+}
+
+yolov8_predictor *yolov8_create(const char *model_path, const yolov8_config *config)
+{
+    lastError.clear();
+    yolov8_config defaults;
+    yolov8_default_config(&defaults);
+    if (!config)
+        config = &defaults;
+    if (!model_path)
+    {
+        lastError = "model_path is null";
+        return nullptr;
+    }
+
+    // no exception may cross into C callers
+    try
+    {
+        PredictorOptions options;
+        options.topK = config->top_k;
+        options.warmup = config->warmup != 0;
+        // masks are read one detection at a time through yolov8_mask, so only those asked for are computed
+        options.lazyMasks = true;
+        // a pool per session: the Env is one per process, global pools would tie every
+        // handle to the thread count of the first
+        options.intraOpThreads = config->intra_op_threads;
+
+        yolov8_predictor *handle = new yolov8_predictor;
+        try
+        {
+            handle->predictor = YOLOPredictor(model_path, config->use_gpu != 0,
+                                              config->conf_threshold,
+                                              config->iou_threshold,
+                                              config->mask_threshold,
+                                              options);
+        }
+        catch (...)
+        {
+            delete handle;
+            throw;
+        }
+        return handle;
+    }
+    catch (const std::exception &e)
+    {
+        lastError = e.what();
+    }
+    catch (...)
+    {
+        lastError = "unknown error";
+    }
+    return nullptr;
+}
+
+void yolov8_destroy(yolov8_predictor *predictor)
+{
+    delete predictor;
+}
+
+int yolov8_class_count(const yolov8_predictor *predictor)
+{
+    return predictor ? predictor->predictor.classNums : -1;
+}
+
+int yolov8_has_masks(const yolov8_predictor *predictor)
+{
+    return predictor ? (int)predictor->predictor.hasMasks() : -1;
+}
+
+int yolov8_detect(yolov8_predictor *predictor,
+                  const uint8_t *bgr, int width, int height, size_t stride,
+                  yolov8_detection *detections, int capacity)
+{
+    lastError.clear();
+    if (!predictor || !bgr || width <= 0 || height <= 0 || stride < (size_t)width * 3 || (capacity > 0 && !detections))
+    {
+        lastError = "invalid argument";
+        return -1;
+    }
+
+    try
+    {
+        // a header over the caller's pixels, preprocessing only reads them
+        cv::Mat image(height, width, CV_8UC3, const_cast<uint8_t *>(bgr), stride);
+        predictor->results = predictor->predictor.predict(image);
+        predictor->imageSize = image.size();
+    }
+    catch (const std::exception &e)
+    {
+        lastError = e.what();
+        return -1;
+    }
+    catch (...)
+    {
+        lastError = "unknown error";
+        return -1;
+    }
+
+    int count = (int)predictor->results.size();
+    for (int i = 0; i < count && i < capacity; i++)
+    {
+        const Yolov8Result &result = predictor->results[i];
+        detections[i] = {result.box.x, result.box.y, result.box.width, result.box.height,
+                         result.conf, result.classId};
+    }
+    return count;
+}
+
+long yolov8_mask(const yolov8_predictor *predictor, int index, uint8_t *mask, size_t capacity)
+{
+    return yolov8_mask_at(predictor, index, 0, 1.0, mask, capacity, nullptr, nullptr);
+}
+
+long yolov8_mask_at(const yolov8_predictor *predictor, int index, int full_image, double scale,
+                    uint8_t *mask, size_t capacity, int *width, int *height)
+{
+    lastError.clear();
+    if (!predictor || index < 0 || index >= (int)predictor->results.size() || scale <= 0.0 || scale > 1.0)
+    {
+        lastError = "invalid argument";
+        return -1;
+    }
+    const Yolov8Result &result = predictor->results[index];
+    if (!predictor->predictor.hasMasks() || (result.boxMask.empty() && !result.protos))
+    {
+        lastError = "model has no masks";
+        return -1;
+    }
+
+    // the size is known without computing the mask, so a size query costs nothing
+    cv::Size size = full_image ? predictor->imageSize : result.box.size();
+    size = cv::Size((int)std::round(size.width * scale), (int)std::round(size.height * scale));
+    if (width)
+        *width = size.width;
+    if (height)
+        *height = size.height;
+    size_t rowBytes = (size_t)size.width;
+    size_t needed = rowBytes * size.height;
+    if (mask && capacity >= needed)
+    {
+        try
+        {
+            cv::Mat computed = full_image ? result.imageMask(predictor->imageSize, scale) : result.mask(scale);
+            // every byte the caller was told about is written, a mask that came back empty is all zeros
+            if (computed.size() != size)
+                std::memset(mask, 0, needed);
+            else
+            {
+                for (int y = 0; y < computed.rows; y++)
+                    std::memcpy(mask + y * rowBytes, computed.ptr<uint8_t>(y), rowBytes);
+            }
+        }
+        catch (const std::exception &e)
+        {
+            lastError = e.what();
+            return -1;
+        }
+    }
+    return (long)needed;
+}
+
+const char *yolov8_last_error(void)
+{
+    return lastError.c_str();
+}
@@ -1,16 +1,52 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <functional>
+#include <mutex>
 #include "yolov8Predictor.h"
+#include "metrics.h"
+#include "tuneProfile.h"
 
 YOLOPredictor::YOLOPredictor(const std::string &modelPath,
                              const bool &isGPU,
                              float confThreshold,
                              float iouThreshold,
-                             float maskThreshold)
+                             float maskThreshold,
+                             const PredictorOptions &baseOptions)
 {
+    auto startTime = std::chrono::steady_clock::now();
+    PredictorOptions options = baseOptions;
+    if (!options.profilePath.empty())
+    {
+        TuneProfile::load(options.profilePath).applyTo(options);
+        std::cout << "Tuning profile: " << options.profilePath << std::endl;
+    }
+    size_t startResident = metrics::residentBytes();
     this->confThreshold = confThreshold;
     this->iouThreshold = iouThreshold;
     this->maskThreshold = maskThreshold;
-    env = Ort::Env(OrtLoggingLevel::ORT_LOGGING_LEVEL_WARNING, "YOLOV8");
+    env = options.env;
+    if (!env)
+    {
+        env = std::make_shared<Ort::Env>(OrtLoggingLevel::ORT_LOGGING_LEVEL_WARNING, "YOLOV8");
+        if (options.arenaMaxBytes > 0 && !isGPU)
+            registerArena(*env, options);
+    }
     sessionOptions = Ort::SessionOptions();
+    // the capped arena registered on the Env replaces the session's own
+    if (options.arenaMaxBytes > 0 && !isGPU)
+        sessionOptions.AddConfigEntry("session.use_env_allocators", "1");
+    if (options.globalThreadPool)
+        sessionOptions.DisablePerSessionThreads();
+    else if (!options.intraOpCpus.empty())
+    {
+        sessionOptions.SetIntraOpNumThreads((int)options.intraOpCpus.size());
+        sessionOptions.AddConfigEntry("session.intra_op_thread_affinities", utils::ortAffinity(options.intraOpCpus).c_str());
+    }
+    else if (options.intraOpThreads > 0)
+        sessionOptions.SetIntraOpNumThreads(options.intraOpThreads);
 
     std::vector<std::string> availableProviders = Ort::GetAvailableProviders();
     auto cudaAvailable = std::find(availableProviders.begin(), availableProviders.end(), "CUDAExecutionProvider");
@@ -24,6 +60,10 @@ YOLOPredictor::YOLOPredictor(const std::string &modelPath,
     else if (isGPU && (cudaAvailable != availableProviders.end()))
     {
         std::cout << "Inference device: GPU" << std::endl;
+        if (options.arenaMaxBytes > 0)
+            cudaOption.gpu_mem_limit = options.arenaMaxBytes;
+        if (options.arenaExtendSameAsRequested)
+            cudaOption.arena_extend_strategy = 1;
         sessionOptions.AppendExecutionProvider_CUDA(cudaOption);
     }
     else
@@ -31,12 +71,70 @@ YOLOPredictor::YOLOPredictor(const std::string &modelPath,
         std::cout << "Inference device: CPU" << std::endl;
     }
 
+    bool ortFormat = std::filesystem::path(modelPath).extension() == ".ort";
+    if (ortFormat)
+    {
+        // weights stay in the mapping instead of being copied into ORT's own buffers
+        sessionOptions.AddConfigEntry("session.load_model_format", "ORT");
+        sessionOptions.AddConfigEntry("session.use_ort_model_bytes_directly", "1");
+        sessionOptions.AddConfigEntry("session.use_ort_model_bytes_for_initializers", "1");
+    }
+    if (!options.optimizedModelPath.empty())
+    {
+#ifdef _WIN32
+        std::wstring w_optimizedPath = utils::charToWstring(options.optimizedModelPath.c_str());
+        sessionOptions.SetOptimizedModelFilePath(w_optimizedPath.c_str());
+#else
+        sessionOptions.SetOptimizedModelFilePath(options.optimizedModelPath.c_str());
+#endif
+    }
+    if (options.profileStartup)
+    {
+#ifdef _WIN32
+        sessionOptions.EnableProfiling(L"yolov8_startup");
+#else
+        sessionOptions.EnableProfiling("yolov8_startup");
+#endif
+    }
+
+    auto readStart = std::chrono::steady_clock::now();
+    if (ortFormat || options.mmapModel)
+    {
+        modelBytes = std::make_shared<MappedFile>(modelPath, true);
+        if (modelBytes->empty())
+            throw std::runtime_error("Cannot map model " + modelPath);
+    }
+    auto readEnd = std::chrono::steady_clock::now();
+
+    prepackedWeights = options.prepackedWeights;
+    sharedWeights = options.sharedWeights;
+    if (sharedWeights)
+        sharedWeights->addTo(sessionOptions);
 #ifdef _WIN32
     std::wstring w_modelPath = utils::charToWstring(modelPath.c_str());
-    session = Ort::Session(env, w_modelPath.c_str(), sessionOptions);
+    const ORTCHAR_T *sessionModelPath = w_modelPath.c_str();
 #else
-    session = Ort::Session(env, modelPath.c_str(), sessionOptions);
+    const ORTCHAR_T *sessionModelPath = modelPath.c_str();
 #endif
+    if (modelBytes && prepackedWeights)
+        session = Ort::Session(*env, modelBytes->data(), modelBytes->size(), sessionOptions, *prepackedWeights);
+    else if (modelBytes)
+        session = Ort::Session(*env, modelBytes->data(), modelBytes->size(), sessionOptions);
+    else if (prepackedWeights)
+        session = Ort::Session(*env, sessionModelPath, sessionOptions, *prepackedWeights);
+    else
+        session = Ort::Session(*env, sessionModelPath, sessionOptions);
+    auto createEnd = std::chrono::steady_clock::now();
+    // an .onnx model is parsed into ORT's own structures, the mapping is no longer needed
+    if (!ortFormat)
+        modelBytes.reset();
+    if (options.profileStartup)
+    {
+        Ort::AllocatorWithDefaultOptions profileAllocator;
+        auto profilePath = session.EndProfilingAllocated(profileAllocator);
+        if (profilePath)
+            utils::printStartupProfile(profilePath.get());
+    }
     const size_t num_input_nodes = session.GetInputCount();   //==1
     const size_t num_output_nodes = session.GetOutputCount(); //==1,2
     if (num_output_nodes > 1)
@@ -48,6 +146,13 @@ YOLOPredictor::YOLOPredictor(const std::string &modelPath,
         std::cout << "Object Detection" << std::endl;
 
     Ort::AllocatorWithDefaultOptions allocator;
+    auto embeddedLetterboxSize = session.GetModelMetadata().LookupCustomMetadataMapAllocated("embedded_letterbox", allocator);
+    if (embeddedLetterboxSize)
+    {
+        std::vector<cv::Size> sizes = utils::parseShapes(embeddedLetterboxSize.get());
+        if (!sizes.empty())
+            this->embeddedLetterbox = sizes[0];
+    }
     for (int i = 0; i < num_input_nodes; i++)
     {
         auto input_name = session.GetInputNameAllocated(i, allocator);
@@ -57,13 +162,30 @@ YOLOPredictor::YOLOPredictor(const std::string &modelPath,
         Ort::TypeInfo inputTypeInfo = session.GetInputTypeInfo(i);
         std::vector<int64_t> inputTensorShape = inputTypeInfo.GetTensorTypeAndShapeInfo().GetShape();
         this->inputShapes.push_back(inputTensorShape);
+        // uint8 inputs come from tools/embed_preprocess.py and are NHWC
+        this->isByteInput = inputTypeInfo.GetTensorTypeAndShapeInfo().GetElementType() == ONNX_TENSOR_ELEMENT_DATA_TYPE_UINT8;
+        int heightAxis = this->isByteInput ? 1 : 2;
+        int widthAxis = this->isByteInput ? 2 : 3;
         this->isDynamicInputShape = false;
+        this->isDynamicBatch = inputTensorShape[0] == -1;
+        if (!this->embeddedLetterbox.empty())
+        {
+            // raw frames of any size go in, the letterbox size is fixed by the graph
+            std::cout << "Embedded preprocessing with letterbox" << std::endl;
+            this->inputSize = this->embeddedLetterbox;
+        }
         // checking if width and height are dynamic
-        if (inputTensorShape[2] == -1 && inputTensorShape[3] == -1)
+        else if (inputTensorShape[heightAxis] == -1 && inputTensorShape[widthAxis] == -1)
         {
             std::cout << "Dynamic input shape" << std::endl;
             this->isDynamicInputShape = true;
         }
+        else
+            this->inputSize = cv::Size((int)inputTensorShape[widthAxis], (int)inputTensorShape[heightAxis]);
+        if (this->isByteInput && this->embeddedLetterbox.empty())
+            std::cout << "Embedded preprocessing" << std::endl;
+        if (this->isDynamicInputShape && !options.inputSize.empty())
+            this->inputSize = options.inputSize;
     }
     for (int i = 0; i < num_output_nodes; i++)
     {
@@ -74,14 +196,56 @@ YOLOPredictor::YOLOPredictor(const std::string &modelPath,
         Ort::TypeInfo outputTypeInfo = session.GetOutputTypeInfo(i);
         std::vector<int64_t> outputTensorShape = outputTypeInfo.GetTensorTypeAndShapeInfo().GetShape();
         this->outputShapes.push_back(outputTensorShape);
-        if (i == 0)
+    }
+    // channel dims stay static even when H/W (and so the anchor count) are dynamic
+    if (this->hasMask)
+        maskNums = (int)this->outputShapes[1][1];
+    // models rewritten by tools/export_nms.py return [N,6(+32)] detections instead of the raw head
+    this->hasEmbeddedNms = this->outputShapes[0].size() == 2;
+    if (this->hasEmbeddedNms)
+    {
+        std::cout << "Embedded NMS" << std::endl;
+        Ort::ModelMetadata metadata = session.GetModelMetadata();
+        auto numClasses = metadata.LookupCustomMetadataMapAllocated("num_classes", allocator);
+        if (numClasses)
+            classNums = std::stoi(numClasses.get());
+    }
+    else
+        classNums = (int)this->outputShapes[0][1] - 4 - (this->hasMask ? maskNums : 0);
+
+    if (!this->hasEmbeddedNms)
+    {
+        const char *decoderName = nullptr;
+        this->headDecoder = selectHeadDecoder(classNums, this->hasMask ? maskNums : 0,
+                                              this->isDynamicInputShape ? -1 : (int)this->outputShapes[0][2],
+                                              &decoderName);
+        std::cout << "Head decoder: " << decoderName << std::endl;
+    }
+
+    this->finalizePool = options.finalizePool;
+    this->contours = options.contours;
+    this->cropMasks = options.cropMasks;
+    this->lazyMasks = options.lazyMasks && this->hasMask && !options.contours;
+    this->memoryBudget = options.memoryBudget;
+    this->topK = options.topK;
+    this->maxPerClass = options.maxPerClass;
+    this->classAllowed.assign(classNums, options.classes.empty());
+    for (int classId : options.classes)
+    {
+        if (classId < 0 || classId >= classNums)
         {
-            if (!this->hasMask)
-                classNums = outputTensorShape[1] - 4;
-            else
-                classNums = outputTensorShape[1] - 4 - 32;
+            std::cout << "Ignore class " << classId << ": model has " << classNums << " classes" << std::endl;
+            continue;
         }
+        this->classAllowed[classId] = true;
     }
+    for (int classId = 0; classId < classNums; classId++)
+    {
+        if (this->classAllowed[classId])
+            this->decodeClasses.push_back(classId);
+    }
+    if (!options.classes.empty())
+        std::cout << "Decoding " << this->decodeClasses.size() << " of " << classNums << " classes" << std::endl;
     // for (const char *x : this->inputNames)
     // {
     //     std::cout << x << std::endl;
@@ -91,174 +255,570 @@ YOLOPredictor::YOLOPredictor(const std::string &modelPath,
     //     std::cout << x << std::endl;
     // }
     // std::cout << classNums << std::endl;
+
+    this->shapeBuckets = options.shapeBuckets;
+    if (options.bucketStep > 0)
+    {
+        std::vector<cv::Size> generated = utils::makeShapeBuckets(this->inputSize, options.bucketStep);
+        this->shapeBuckets.insert(this->shapeBuckets.end(), generated.begin(), generated.end());
+    }
+    if (!this->shapeBuckets.empty())
+    {
+        if (this->isDynamicInputShape)
+            std::cout << "Shape buckets: " << this->shapeBuckets.size() << std::endl;
+        else
+            std::cout << "Static input shape, shape buckets are ignored." << std::endl;
+    }
+
+    this->resultCache = options.resultCache;
+    if (this->resultCache)
+    {
+        // which masks the budget crops depends on resident memory, and cached results must not
+        if (this->memoryBudget > 0 && this->hasMask && !this->cropMasks)
+        {
+            this->cropMasks = true;
+            std::cout << "Result cache with a memory budget: masks are always cropped" << std::endl;
+        }
+        std::stringstream config;
+        config << modelPath << "|" << std::filesystem::file_size(modelPath) << "|"
+               << std::filesystem::last_write_time(modelPath).time_since_epoch().count() << "|"
+               << confThreshold << "|" << iouThreshold << "|" << maskThreshold << "|"
+               << inputSize.width << "x" << inputSize.height << "|" << topK << "|" << maxPerClass << "|"
+               << cropMasks << "|" << contours << "|";
+        for (const cv::Size &bucket : this->shapeBuckets)
+            config << bucket.width << "x" << bucket.height << ",";
+        config << "|";
+        for (int classId : this->decodeClasses)
+            config << classId << ",";
+        std::string configString = config.str();
+        this->configHash = utils::hashBytes(configString.data(), configString.size());
+    }
+
+    auto sessionTime = std::chrono::steady_clock::now();
+    if (options.warmup)
+    {
+        std::vector<cv::Size> shapes = options.warmupShapes;
+        if (shapes.empty() && this->isDynamicInputShape && !this->shapeBuckets.empty())
+            shapes = this->shapeBuckets;
+        else if (shapes.empty())
+            shapes.push_back(this->inputSize);
+        this->warmup(shapes, options.warmupBatchSizes);
+    }
+    auto readyTime = std::chrono::steady_clock::now();
+
+    auto ms = [](std::chrono::steady_clock::duration duration)
+    { return std::chrono::duration<double, std::milli>(duration).count(); };
+    std::cout << "Startup: read " << ms(readEnd - readStart) << "ms"
+              << (modelBytes || options.mmapModel ? " (mmap)" : " (inside session)")
+              << ", session " << ms(createEnd - readEnd) << "ms"
+              << ", setup " << ms(sessionTime - createEnd) << "ms"
+              << ", warmup " << ms(readyTime - sessionTime) << "ms" << std::endl;
+    std::cout << "Model ready after "
+              << std::chrono::duration<double, std::milli>(readyTime - startTime).count() << "ms" << std::endl;
+    // includes the arenas grown by warmup; compare it across instances to see what sharing saves
+    size_t readyResident = metrics::residentBytes();
+    if (readyResident)
+        std::cout << "Session memory: +" << (double)(readyResident - std::min(readyResident, startResident)) / (1024 * 1024)
+                  << "MB resident, " << readyResident / (1024 * 1024) << "MB total"
+                  << (prepackedWeights ? ", shared pre-packed weights" : "")
+                  << (sharedWeights ? ", shared initializers" : "")
+                  << (options.arenaMaxBytes > 0 ? ", arena capped at " + std::to_string(options.arenaMaxBytes / (1024 * 1024)) + "MB" : "")
+                  << std::endl;
 }
 
-void YOLOPredictor::getBestClassInfo(std::vector<float>::iterator it,
-                                     float &bestConf,
-                                     int &bestClassId,
-                                     const int _classNums)
+void YOLOPredictor::registerArena(Ort::Env &env, const PredictorOptions &options)
 {
-    // first 4 element are box
-    bestClassId = 4;
-    bestConf = 0;
+    // every Ort::Env wraps the same process-wide OrtEnv, which rejects a second registration
+    static std::mutex registerMutex;
+    static bool registered = false;
+    std::lock_guard<std::mutex> lock(registerMutex);
+    if (registered)
+        return;
+    // -1 keeps ORT's defaults for the initial chunk and the dead bytes per chunk
+    Ort::ArenaCfg arenaConfig(options.arenaMaxBytes, options.arenaExtendSameAsRequested ? 1 : 0, -1, -1);
+    Ort::MemoryInfo memoryInfo = Ort::MemoryInfo::CreateCpu(
+        OrtAllocatorType::OrtArenaAllocator, OrtMemType::OrtMemTypeDefault);
+    env.CreateAndRegisterAllocator(memoryInfo, arenaConfig);
+    registered = true;
+}
 
-    for (int i = 4; i < _classNums + 4; i++)
+void YOLOPredictor::warmup(const std::vector<cv::Size> &shapes, const std::vector<int> &batchSizes)
+{
+    Ort::MemoryInfo memoryInfo = Ort::MemoryInfo::CreateCpu(
+        OrtAllocatorType::OrtArenaAllocator, OrtMemType::OrtMemTypeDefault);
+
+    for (const cv::Size &shape : shapes)
     {
-        if (it[i] > bestConf)
+        if (!this->isDynamicInputShape && shape != this->inputSize)
         {
-            bestConf = it[i];
-            bestClassId = i - 4;
+            std::cout << "Skip warmup " << shape.width << "x" << shape.height
+                      << ": model input shape is static" << std::endl;
+            continue;
+        }
+        for (int batchSize : batchSizes)
+        {
+            if (batchSize != 1 && !this->isDynamicBatch)
+            {
+                std::cout << "Skip warmup batch " << batchSize << ": model batch size is static" << std::endl;
+                continue;
+            }
+            auto startTime = std::chrono::steady_clock::now();
+
+            std::vector<int64_t> inputTensorShape{batchSize, 3, shape.height, shape.width};
+            if (this->isByteInput)
+                inputTensorShape = {batchSize, shape.height, shape.width, 3};
+            size_t inputTensorSize = utils::vectorProduct(inputTensorShape);
+            // letterbox padding value, so the run looks like a real (empty) frame
+            std::vector<float> inputTensorValues;
+            std::vector<uint8_t> inputTensorBytes;
+
+            std::vector<Ort::Value> inputTensors;
+            if (this->isByteInput)
+            {
+                inputTensorBytes.assign(inputTensorSize, 114);
+                inputTensors.push_back(Ort::Value::CreateTensor<uint8_t>(
+                    memoryInfo, inputTensorBytes.data(), inputTensorSize,
+                    inputTensorShape.data(), inputTensorShape.size()));
+            }
+            else
+            {
+                inputTensorValues.assign(inputTensorSize, 114.0f / 255.0f);
+                inputTensors.push_back(Ort::Value::CreateTensor<float>(
+                    memoryInfo, inputTensorValues.data(), inputTensorSize,
+                    inputTensorShape.data(), inputTensorShape.size()));
+            }
+
+            this->session.Run(Ort::RunOptions{nullptr},
+                              this->inputNames.data(),
+                              inputTensors.data(),
+                              1,
+                              this->outputNames.data(),
+                              this->outputNames.size());
+
+            auto endTime = std::chrono::steady_clock::now();
+            std::cout << "Warmup " << shape.width << "x" << shape.height << " batch " << batchSize << ": "
+                      << std::chrono::duration<double, std::milli>(endTime - startTime).count() << "ms" << std::endl;
         }
     }
 }
+
+void YOLOPredictor::findContours(Yolov8Result &result) const
+{
+    result.contours.clear();
+    if (result.boxMask.empty())
+        return;
+    cv::findContours(result.boxMask.clone(), result.contours, cv::RETR_EXTERNAL, cv::CHAIN_APPROX_SIMPLE,
+                     result.box.tl());
+}
+
 cv::Mat YOLOPredictor::getMask(const cv::Mat &maskProposals,
-                               const cv::Mat &maskProtos)
+                               const cv::Mat &maskProtos,
+                               const cv::Size &inputShape)
 {
-    cv::Mat protos = maskProtos.reshape(0, {(int)this->outputShapes[1][1], (int)this->outputShapes[1][2] * (int)this->outputShapes[1][3]});
+    // maskProtos is [1,32,h,w], with h/w following the actual input size
+    int protoHeight = maskProtos.size[2];
+    int protoWidth = maskProtos.size[3];
+    cv::Mat protos = maskProtos.reshape(0, {maskNums, protoHeight * protoWidth});
 
     cv::Mat matmul_res = (maskProposals * protos).t();
-    cv::Mat masks = matmul_res.reshape(1, {(int)this->outputShapes[1][2], (int)this->outputShapes[1][3]});
+    cv::Mat masks = matmul_res.reshape(1, {protoHeight, protoWidth});
     cv::Mat dest;
 
     // sigmoid
     cv::exp(-masks, dest);
     dest = 1.0 / (1.0 + dest);
-    cv::resize(dest, dest, cv::Size((int)this->inputShapes[0][2], (int)this->inputShapes[0][3]), cv::INTER_LINEAR);
+    cv::resize(dest, dest, inputShape, cv::INTER_LINEAR);
     return dest;
 }
 
-void YOLOPredictor::preprocessing(cv::Mat &image, float *&blob, std::vector<int64_t> &inputTensorShape)
+cv::Mat YOLOPredictor::letterboxFrame(cv::Mat &image, const cv::Size &targetSize)
 {
-    cv::Mat resizedImage, floatImage;
-    cv::cvtColor(image, resizedImage, cv::COLOR_BGR2RGB);
-    utils::letterbox(resizedImage, resizedImage, cv::Size((int)this->inputShapes[0][2], (int)this->inputShapes[0][3]),
+    cv::Mat resizedImage;
+    utils::letterbox(image, resizedImage, targetSize,
                      cv::Scalar(114, 114, 114), this->isDynamicInputShape,
                      false, true, 32);
 
-    inputTensorShape[2] = resizedImage.rows;
-    inputTensorShape[3] = resizedImage.cols;
+    // pad up to a warmed bucket shape, split evenly so scaleCoords still sees a centered letterbox
+    cv::Size bucket;
+    if (this->isDynamicInputShape && utils::selectShapeBucket(resizedImage.size(), this->shapeBuckets, bucket))
+    {
+        int dw = bucket.width - resizedImage.cols;
+        int dh = bucket.height - resizedImage.rows;
+        cv::copyMakeBorder(resizedImage, resizedImage, dh / 2, dh - dh / 2, dw / 2, dw - dw / 2,
+                           cv::BORDER_CONSTANT, cv::Scalar(114, 114, 114));
+    }
+    return resizedImage;
+}
+
+void YOLOPredictor::preprocessing(cv::Mat &image, LetterboxedInput &input, const cv::Size &targetSize)
+{
+    if (!this->embeddedLetterbox.empty())
+    {
+        // the graph resizes, pads, casts and normalizes; the frame is passed without a copy
+        input.pixels = image.isContinuous() ? image : image.clone();
+        input.shape = {1, image.rows, image.cols, 3};
+        input.letterboxShape = this->embeddedLetterbox;
+        return;
+    }
+
+    // resizing before the color conversion gives the same pixels and converts fewer of them
+    cv::Mat resizedImage = this->letterboxFrame(image, targetSize);
+    input.letterboxShape = resizedImage.size();
+    if (this->isByteInput)
+    {
+        input.pixels = resizedImage.isContinuous() ? resizedImage : resizedImage.clone();
+        input.shape = {1, resizedImage.rows, resizedImage.cols, 3};
+        return;
+    }
+
+    cv::Mat floatImage;
+    cv::cvtColor(resizedImage, resizedImage, cv::COLOR_BGR2RGB);
+    input.shape[2] = resizedImage.rows;
+    input.shape[3] = resizedImage.cols;
 
     resizedImage.convertTo(floatImage, CV_32FC3, 1 / 255.0);
-    blob = new float[floatImage.cols * floatImage.rows * floatImage.channels()];
+    input.blob.resize(floatImage.cols * floatImage.rows * floatImage.channels());
     cv::Size floatImageSize{floatImage.cols, floatImage.rows};
 
     // hwc -> chw
     std::vector<cv::Mat> chw(floatImage.channels());
     for (int i = 0; i < floatImage.channels(); ++i)
     {
-        chw[i] = cv::Mat(floatImageSize, CV_32FC1, blob + i * floatImageSize.width * floatImageSize.height);
+        chw[i] = cv::Mat(floatImageSize, CV_32FC1, input.blob.data() + i * floatImageSize.width * floatImageSize.height);
     }
     cv::split(floatImage, chw);
 }
 
 std::vector<Yolov8Result> YOLOPredictor::postprocessing(const cv::Size &resizedImageShape,
                                                         const cv::Size &originalImageShape,
-                                                        std::vector<Ort::Value> &outputTensors)
+                                                        std::vector<Ort::Value> &outputTensors,
+                                                        size_t batchIndex,
+                                                        std::shared_ptr<const void> outputOwner)
 {
 
     // for box
     std::vector<cv::Rect> boxes;
     std::vector<float> confs;
     std::vector<int> classIds;
-
-    float *boxOutput = outputTensors[0].GetTensorMutableData<float>();
-    //[1,4+n,8400]=>[1,8400,4+n] or [1,4+n+32,8400]=>[1,8400,4+n+32]
-    cv::Mat output0 = cv::Mat(cv::Size((int)this->outputShapes[0][2], (int)this->outputShapes[0][1]), CV_32F, boxOutput).t();
-    float *output0ptr = (float *)output0.data;
-    int rows = (int)this->outputShapes[0][2];
-    int cols = (int)this->outputShapes[0][1];
-    // std::cout << rows << cols << std::endl;
     // if hasMask
     std::vector<std::vector<float>> picked_proposals;
     cv::Mat mask_protos;
+    std::vector<int> indices;
 
-    for (int i = 0; i < rows; i++)
-    {
-        std::vector<float> it(output0ptr + i * cols, output0ptr + (i + 1) * cols);
-        float confidence;
-        int classId;
-        this->getBestClassInfo(it.begin(), confidence, classId, classNums);
+    float *boxOutput = outputTensors[0].GetTensorMutableData<float>();
+    // the anchor count depends on the input size, read it from the actual output
+    std::vector<int64_t> output0Shape = outputTensors[0].GetTensorTypeAndShapeInfo().GetShape();
+    // frames of a batch follow each other, embedded-NMS outputs have no batch dimension
+    if (!this->hasEmbeddedNms)
+        boxOutput += batchIndex * (size_t)(output0Shape[1] * output0Shape[2]);
 
-        if (confidence > this->confThreshold)
+    if (this->hasEmbeddedNms)
+    {
+        // [N,6] or [N,6+32] rows of cx,cy,w,h,conf,class(,mask coeffs), NMS and top-k already ran in the graph
+        int rows = (int)output0Shape[0];
+        int cols = (int)output0Shape[1];
+        for (int i = 0; i < rows; i++)
         {
+            const float *it = boxOutput + i * cols;
+            int classId = (int)it[5];
+            if (it[4] <= this->confThreshold || classId < 0 || classId >= classNums || !this->classAllowed[classId])
+                continue;
+            if (this->topK > 0 && (int)indices.size() == this->topK)
+                break;
             if (this->hasMask)
-            {
-                std::vector<float> temp(it.begin() + 4 + classNums, it.end());
-                picked_proposals.push_back(temp);
-            }
+                picked_proposals.emplace_back(it + 6, it + cols);
+
             int centerX = (int)(it[0]);
             int centerY = (int)(it[1]);
             int width = (int)(it[2]);
             int height = (int)(it[3]);
             int left = centerX - width / 2;
             int top = centerY - height / 2;
+            indices.push_back((int)boxes.size());
             boxes.emplace_back(left, top, width, height);
-            confs.emplace_back(confidence);
+            confs.emplace_back(it[4]);
             classIds.emplace_back(classId);
         }
     }
-
-    std::vector<int> indices;
-    cv::dnn::NMSBoxes(boxes, confs, this->confThreshold, this->iouThreshold, indices);
+    else
+    {
+        // [1,4+n(+32),A]: every channel is a contiguous plane of A anchors, so only the
+        // allowed class planes are read and nothing is transposed
+        std::vector<float> bestConfs;
+        std::vector<int> bestClassIds;
+        DecodeParams params;
+        params.confThreshold = this->confThreshold;
+        params.topK = this->topK;
+        params.classes = &this->decodeClasses;
+        params.bestConfs = &bestConfs;
+        params.bestClassIds = &bestClassIds;
+        HeadCandidates candidates;
+        this->headDecoder(boxOutput, classNums, this->hasMask ? maskNums : 0, (int)output0Shape[2], params, candidates);
+        boxes = std::move(candidates.boxes);
+        confs = std::move(candidates.confs);
+        classIds = std::move(candidates.classIds);
+        picked_proposals = std::move(candidates.proposals);
+
+        cv::dnn::NMSBoxes(boxes, confs, this->confThreshold, this->iouThreshold, indices);
+    }
 
     if (this->hasMask)
     {
         float *maskOutput = outputTensors[1].GetTensorMutableData<float>();
-        std::vector<int> mask_protos_shape = {1, (int)this->outputShapes[1][1], (int)this->outputShapes[1][2], (int)this->outputShapes[1][3]};
+        std::vector<int64_t> output1Shape = outputTensors[1].GetTensorTypeAndShapeInfo().GetShape();
+        maskOutput += batchIndex * (size_t)(output1Shape[1] * output1Shape[2] * output1Shape[3]);
+        std::vector<int> mask_protos_shape = {1, (int)output1Shape[1], (int)output1Shape[2], (int)output1Shape[3]};
         mask_protos = cv::Mat(mask_protos_shape, CV_32F, maskOutput);
     }
 
-    std::vector<Yolov8Result> results;
+    std::vector<int> kept;
+    std::vector<int> classCounts(classNums, 0);
     for (int idx : indices)
     {
-        Yolov8Result res;
+        // indices are sorted by confidence, so the per-class limit keeps the best ones
+        if (this->maxPerClass > 0 && classCounts[classIds[idx]]++ >= this->maxPerClass)
+            continue;
+        kept.push_back(idx);
+    }
+
+    // a full-frame float mask per detection is what makes crowded frames expensive in memory
+    bool cropLocal = this->hasMask &&
+                     (this->lazyMasks || this->cropMasks ||
+                      (this->memoryBudget > 0 && metrics::residentBytes() > this->memoryBudget / 4 * 3));
+    std::shared_ptr<const MaskProtos> frameProtos;
+    if (cropLocal)
+        frameProtos = std::make_shared<MaskProtos>((const float *)mask_protos.data, mask_protos.size[1], mask_protos.size[2], mask_protos.size[3],
+                                                   resizedImageShape, originalImageShape, this->maskThreshold,
+                                                   this->lazyMasks ? outputOwner : nullptr);
+
+    // every detection owns its slot, so the order does not depend on which thread finishes first
+    std::vector<Yolov8Result> results(kept.size());
+    auto finalize = [&](size_t slot)
+    {
+        int idx = kept[slot];
+        Yolov8Result &res = results[slot];
         res.box = cv::Rect(boxes[idx]);
-        if (this->hasMask)
-            res.boxMask = this->getMask(cv::Mat(picked_proposals[idx]).t(), mask_protos);
+        if (cropLocal)
+        {
+            utils::scaleBox(res.box, resizedImageShape, originalImageShape);
+            if (this->lazyMasks)
+            {
+                res.maskCoeffs = std::move(picked_proposals[idx]);
+                res.protos = frameProtos;
+            }
+            else
+                res.boxMask = frameProtos->boxMask(picked_proposals[idx].data(), res.box, res.box.size());
+        }
         else
-            res.boxMask = cv::Mat::zeros((int)this->inputShapes[0][2], (int)this->inputShapes[0][3], CV_8U);
-
-        utils::scaleCoords(res.box, res.boxMask, this->maskThreshold, resizedImageShape, originalImageShape);
+        {
+            if (this->hasMask)
+                res.boxMask = this->getMask(cv::Mat(picked_proposals[idx]).t(), mask_protos, resizedImageShape);
+            else
+                res.boxMask = cv::Mat::zeros(resizedImageShape, CV_8U);
+            utils::scaleCoords(res.box, res.boxMask, this->maskThreshold, resizedImageShape, originalImageShape);
+        }
         res.conf = confs[idx];
         res.classId = classIds[idx];
-        results.emplace_back(res);
+        if (this->contours && this->hasMask)
+            this->findContours(res);
+    };
+    // handing out a few detections costs more than finalizing them in place
+    if (this->finalizePool && kept.size() >= 4)
+        this->finalizePool->parallelFor(kept.size(), finalize);
+    else
+    {
+        for (size_t slot = 0; slot < kept.size(); slot++)
+            finalize(slot);
     }
+    metrics::add(metrics::RESULT_BYTES, utils::resultBytes(results));
 
     return results;
 }
 
 std::vector<Yolov8Result> YOLOPredictor::predict(cv::Mat &image)
 {
-    float *blob = nullptr;
-    std::vector<int64_t> inputTensorShape{1, 3, -1, -1};
-    this->preprocessing(image, blob, inputTensorShape);
+    uint64_t contentHash = 0;
+    std::vector<Yolov8Result> result;
+    if (this->resultCache)
+    {
+        contentHash = ResultCache::hashImage(image);
+        if (this->lookupCache(contentHash, result))
+            return result;
+    }
 
-    size_t inputTensorSize = utils::vectorProduct(inputTensorShape);
+    LetterboxedInput input;
+    this->prepare(image, input);
+    result = this->predict(input);
 
-    std::vector<float> inputTensorValues(blob, blob + inputTensorSize);
+    if (this->resultCache)
+        this->storeCache(contentHash, result, image.total() * image.elemSize());
+    return result;
+}
 
-    std::vector<Ort::Value> inputTensors;
+std::vector<std::vector<Yolov8Result>> YOLOPredictor::predictBatch(std::vector<cv::Mat> &images)
+{
+    std::vector<std::vector<Yolov8Result>> results(images.size());
+    std::vector<LetterboxedInput> inputs(images.size());
+    for (size_t i = 0; i < images.size(); i++)
+        this->prepare(images[i], inputs[i]);
+
+    bool batched = images.size() > 1 && !this->hasEmbeddedNms &&
+                   (this->isDynamicBatch || this->inputShapes[0][0] == (int64_t)images.size());
+    for (size_t i = 1; batched && i < inputs.size(); i++)
+        batched = inputs[i].shape == inputs[0].shape;
+    if (!batched)
+    {
+        for (size_t i = 0; i < images.size(); i++)
+            results[i] = this->predict(inputs[i]);
+        return results;
+    }
 
+    std::vector<int64_t> shape = inputs[0].shape;
+    shape[0] = (int64_t)images.size();
+    size_t frameSize = utils::vectorProduct(inputs[0].shape);
     Ort::MemoryInfo memoryInfo = Ort::MemoryInfo::CreateCpu(
         OrtAllocatorType::OrtArenaAllocator, OrtMemType::OrtMemTypeDefault);
+    std::vector<float> blob;
+    std::vector<uint8_t> pixels;
+    std::vector<Ort::Value> inputTensors;
+    if (!inputs[0].pixels.empty())
+    {
+        pixels.resize(frameSize * images.size());
+        for (size_t i = 0; i < inputs.size(); i++)
+            std::memcpy(pixels.data() + i * frameSize, inputs[i].pixels.data, frameSize);
+        inputTensors.push_back(Ort::Value::CreateTensor<uint8_t>(
+            memoryInfo, pixels.data(), pixels.size(), shape.data(), shape.size()));
+    }
+    else
+    {
+        blob.resize(frameSize * images.size());
+        for (size_t i = 0; i < inputs.size(); i++)
+            std::memcpy(blob.data() + i * frameSize, inputs[i].blob.data(), frameSize * sizeof(float));
+        inputTensors.push_back(Ort::Value::CreateTensor<float>(
+            memoryInfo, blob.data(), blob.size(), shape.data(), shape.size()));
+    }
 
-    inputTensors.push_back(Ort::Value::CreateTensor<float>(
-        memoryInfo, inputTensorValues.data(), inputTensorSize,
-        inputTensorShape.data(), inputTensorShape.size()));
-
+    auto runStart = std::chrono::steady_clock::now();
     std::vector<Ort::Value> outputTensors = this->session.Run(Ort::RunOptions{nullptr},
                                                               this->inputNames.data(),
                                                               inputTensors.data(),
                                                               1,
                                                               this->outputNames.data(),
                                                               this->outputNames.size());
+    auto runEnd = std::chrono::steady_clock::now();
+    metrics::observe(metrics::STAGE_INFERENCE, std::chrono::duration<double, std::milli>(runEnd - runStart).count());
+
+    // lazy results of every frame keep the output tensors alive
+    std::shared_ptr<std::vector<Ort::Value>> outputOwner;
+    if (this->lazyMasks)
+        outputOwner = std::make_shared<std::vector<Ort::Value>>(std::move(outputTensors));
+    std::vector<Ort::Value> &outputs = outputOwner ? *outputOwner : outputTensors;
+    for (size_t i = 0; i < inputs.size(); i++)
+    {
+        results[i] = this->postprocessing(inputs[i].letterboxShape, inputs[i].originalShape, outputs, i, outputOwner);
+        metrics::observeDetections(results[i].size());
+    }
+    metrics::observe(metrics::STAGE_POSTPROCESS,
+                     std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - runEnd).count());
+    return results;
+}
+
+bool YOLOPredictor::lookupCache(uint64_t contentHash, std::vector<Yolov8Result> &results, bool count)
+{
+    if (!this->resultCache)
+        return false;
+    bool hit = this->resultCache->get(utils::hashBytes(&contentHash, sizeof(contentHash), this->configHash), results, count);
+    if (count)
+        metrics::add(hit ? metrics::CACHE_HITS : metrics::CACHE_MISSES);
+    // the disk tier keeps masks only, outlines are traced again from them
+    if (hit && this->contours && this->hasMask)
+    {
+        for (Yolov8Result &result : results)
+        {
+            if (result.contours.empty())
+                this->findContours(result);
+        }
+    }
+    return hit;
+}
+
+void YOLOPredictor::storeCache(uint64_t contentHash, const std::vector<Yolov8Result> &results, size_t inputBytes)
+{
+    if (this->resultCache)
+        this->resultCache->put(utils::hashBytes(&contentHash, sizeof(contentHash), this->configHash), results, inputBytes);
+}
 
-    cv::Size resizedShape = cv::Size((int)inputTensorShape[3], (int)inputTensorShape[2]);
-    std::vector<Yolov8Result> result = this->postprocessing(resizedShape,
-                                                            image.size(),
-                                                            outputTensors);
+void YOLOPredictor::prepare(cv::Mat &image, LetterboxedInput &input)
+{
+    this->prepare(image, input, this->inputSize);
+}
+
+void YOLOPredictor::prepare(cv::Mat &image, LetterboxedInput &input, const cv::Size &inputSize)
+{
+    input.shape = {1, 3, -1, -1};
+    input.pixels = cv::Mat();
+    input.originalShape = image.size();
+    metrics::ScopedTimer timer(metrics::STAGE_PREPROCESS);
+    // a static-shape model only ever accepts its own size
+    this->preprocessing(image, input, this->isDynamicInputShape ? inputSize : this->inputSize);
+}
 
-    delete[] blob;
+std::vector<Yolov8Result> YOLOPredictor::predict(cv::Mat &image, const cv::Size &inputSize)
+{
+    LetterboxedInput input;
+    this->prepare(image, input, inputSize);
+    return this->predict(input);
+}
+
+bool YOLOPredictor::sharesPreprocessing(const YOLOPredictor &other) const
+{
+    return this->inputSize == other.inputSize &&
+           this->isDynamicInputShape == other.isDynamicInputShape &&
+           this->isByteInput == other.isByteInput &&
+           this->embeddedLetterbox == other.embeddedLetterbox &&
+           this->shapeBuckets == other.shapeBuckets;
+}
+
+std::vector<Yolov8Result> YOLOPredictor::predict(const LetterboxedInput &input)
+{
+    size_t inputTensorSize = utils::vectorProduct(input.shape);
+
+    std::vector<Ort::Value> inputTensors;
+
+    Ort::MemoryInfo memoryInfo = Ort::MemoryInfo::CreateCpu(
+        OrtAllocatorType::OrtArenaAllocator, OrtMemType::OrtMemTypeDefault);
+
+    // ORT does not write to inputs, the same blob may feed several models
+    if (!input.pixels.empty())
+        inputTensors.push_back(Ort::Value::CreateTensor<uint8_t>(
+            memoryInfo, input.pixels.data, inputTensorSize,
+            input.shape.data(), input.shape.size()));
+    else
+        inputTensors.push_back(Ort::Value::CreateTensor<float>(
+            memoryInfo, const_cast<float *>(input.blob.data()), inputTensorSize,
+            input.shape.data(), input.shape.size()));
+
+    auto runStart = std::chrono::steady_clock::now();
+    std::vector<Ort::Value> outputTensors = this->session.Run(Ort::RunOptions{nullptr},
+                                                              this->inputNames.data(),
+                                                              inputTensors.data(),
+                                                              1,
+                                                              this->outputNames.data(),
+                                                              this->outputNames.size());
+    auto runEnd = std::chrono::steady_clock::now();
+    metrics::observe(metrics::STAGE_INFERENCE, std::chrono::duration<double, std::milli>(runEnd - runStart).count());
+
+    // lazy results keep the output tensors alive
+    std::shared_ptr<std::vector<Ort::Value>> outputOwner;
+    if (this->lazyMasks)
+        outputOwner = std::make_shared<std::vector<Ort::Value>>(std::move(outputTensors));
+    std::vector<Yolov8Result> result = this->postprocessing(input.letterboxShape,
+                                                            input.originalShape,
+                                                            outputOwner ? *outputOwner : outputTensors,
+                                                            0, outputOwner);
+    metrics::observe(metrics::STAGE_POSTPROCESS,
+                     std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - runEnd).count());
+    metrics::observeDetections(result.size());
 
     return result;
 }
@@ -0,0 +1,29 @@
+#!/bin/sh
+# Throughput of the pipelined CLI with and without cpu pinning on the sample images.
+# Usage: sh tools/bench_affinity.sh [model] [node]   (defaults: yolov8m.onnx, NUMA node 0)
+# Pinning uses the cpus of one node: two for decode, two for encode, the rest for ORT.
+MODEL=${1:-./models/yolov8m.onnx}
+NODE=${2:-0}
+BIN=./build/yolov8_ort
+ARGS="-m $MODEL -c ./models/coco.names -i ./Imginput --no_save --no_warmup --pipeline 2,1,2"
+
+CPULIST=$(cat /sys/devices/system/node/node$NODE/cpulist 2>/dev/null)
+if [ -z "$CPULIST" ]; then
+    echo "No NUMA node $NODE"
+    exit 1
+fi
+# expand "0-7,16-23" into one cpu per line
+CPUS=$(echo "$CPULIST" | tr ',' '\n' | awk -F- '{ if (NF == 2) for (i = $1; i <= $2; i++) print i; else print $1 }')
+COUNT=$(echo "$CPUS" | wc -l)
+if [ "$COUNT" -lt 6 ]; then
+    echo "Node $NODE has only $COUNT cpus, need at least 6"
+    exit 1
+fi
+DECODE=$(echo "$CPUS" | sed -n '1,2p' | paste -sd,)
+ENCODE=$(echo "$CPUS" | sed -n '3,4p' | paste -sd,)
+ORT=$(echo "$CPUS" | sed -n "5,${COUNT}p" | paste -sd,)
+
+echo "unpinned:"
+$BIN $ARGS --threads $((COUNT - 4)) | grep Throughput
+echo "pinned to node $NODE (decode $DECODE, encode $ENCODE, ort $ORT):"
+$BIN $ARGS --numa_node $NODE --ort_cpus "$ORT" --pin "$DECODE;$ORT;$ENCODE" | grep Throughput
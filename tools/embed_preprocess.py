@@ -0,0 +1,153 @@
+"""Move YOLOv8 input preprocessing into the ONNX graph.
+
+The float [N,3,H,W] RGB input in [0,1] is replaced by a uint8 [N,H,W,3] BGR input, as
+OpenCV decodes it. Cast, transpose, the BGR->RGB swap and the 1/255 scale run inside the
+session. When the input feeds a single Conv, the swap and the scale are folded into its
+weights, so normalization costs nothing at run time. With --letterbox the graph also
+resizes and pads frames of any size to WxH, and the host passes decoded frames as they are.
+
+The predictor recognizes the rewritten model by its uint8 input (and the embedded_letterbox
+metadata entry) and skips its own float conversion:
+
+    python tools/embed_preprocess.py -i models/yolov8m.onnx -o models/yolov8m-u8.onnx
+    python tools/embed_preprocess.py -i models/yolov8m.onnx -o models/yolov8m-u8lb.onnx --letterbox 640x640
+"""
+import argparse
+
+import onnx
+from onnx import TensorProto, helper, numpy_helper
+import numpy as np
+
+
+def const(name, value, dtype):
+    return numpy_helper.from_array(np.array(value, dtype=dtype), name)
+
+
+def set_metadata(model, key, value):
+    entry = next((p for p in model.metadata_props if p.key == key), None)
+    if entry is None:
+        entry = model.metadata_props.add()
+    entry.key, entry.value = key, value
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("-i", "--input", required=True, help="YOLOv8 ONNX model exported by ultralytics.")
+    parser.add_argument("-o", "--output", required=True, help="Path to save the rewritten model.")
+    parser.add_argument("--letterbox", default="", help="Also resize and pad raw frames to WxH inside the graph.")
+    parser.add_argument("--no-fold", action="store_true",
+                        help="Keep the channel swap and scale as graph ops instead of folding them into the first Conv.")
+    args = parser.parse_args()
+
+    model = onnx.load(args.input)
+    graph = model.graph
+    opset = next(o.version for o in model.opset_import if o.domain in ("", "ai.onnx"))
+    if opset < 11:
+        raise SystemExit("opset %d is too old, Resize with sizes needs 11" % opset)
+
+    image = graph.input[0]
+    float_type = image.type.tensor_type.elem_type
+    dims = list(image.type.tensor_type.shape.dim)
+    if float_type not in (TensorProto.FLOAT, TensorProto.FLOAT16) or len(dims) != 4 or dims[1].dim_value != 3:
+        raise SystemExit("%s is not a float [N,3,H,W] image input" % image.name)
+    np_float = np.float16 if float_type == TensorProto.FLOAT16 else np.float32
+
+    name = image.name
+    normalized = name + "_normalized"
+    consumers = [node for node in graph.node if name in node.input]
+    for node in consumers:
+        node.input[:] = [normalized if x == name else x for x in node.input]
+
+    nodes = []
+    x = name
+    if args.letterbox:
+        width, height = (int(v) for v in args.letterbox.lower().split("x"))
+        graph.initializer.extend([
+            const("pre_hw_starts", [1], np.int64), const("pre_hw_ends", [3], np.int64),
+            const("pre_target_f", [height, width], np.float32), const("pre_target", [height, width], np.int64),
+            const("pre_two", [2, 2], np.int64), const("pre_zero2", [0, 0], np.int64),
+            const("pre_zero", [0], np.int64), const("pre_one", [1], np.int64), const("pre_channels", [3], np.int64),
+            const("pre_empty", [], np.float32), const("pre_pad_value", 114, np.uint8),
+        ])
+        nodes += [
+            # r = min(H/h, W/w), the same scale utils::letterbox picks
+            helper.make_node("Shape", [x], ["pre_shape"]),
+            helper.make_node("Slice", ["pre_shape", "pre_hw_starts", "pre_hw_ends"], ["pre_hw"]),
+            helper.make_node("Cast", ["pre_hw"], ["pre_hw_f"], to=TensorProto.FLOAT),
+            helper.make_node("Div", ["pre_target_f", "pre_hw_f"], ["pre_ratios"]),
+            helper.make_node("ReduceMin", ["pre_ratios"], ["pre_r"], keepdims=1),
+            helper.make_node("Mul", ["pre_hw_f", "pre_r"], ["pre_new_hw_f"]),
+            helper.make_node("Round", ["pre_new_hw_f"], ["pre_new_hw_r"]),
+            helper.make_node("Cast", ["pre_new_hw_r"], ["pre_new_hw"], to=TensorProto.INT64),
+            helper.make_node("Slice", ["pre_shape", "pre_zero", "pre_one"], ["pre_batch"]),
+            helper.make_node("Concat", ["pre_batch", "pre_new_hw", "pre_channels"], ["pre_sizes"], axis=0),
+            # still uint8 NHWC, so the full-size frame is never expanded to float
+            helper.make_node("Resize", [x, "pre_empty", "pre_empty", "pre_sizes"], ["pre_resized"],
+                             mode="linear", coordinate_transformation_mode="half_pixel"),
+            # centered padding, the smaller half before, as utils::letterbox does
+            helper.make_node("Sub", ["pre_target", "pre_new_hw"], ["pre_gap"]),
+            helper.make_node("Div", ["pre_gap", "pre_two"], ["pre_before"]),
+            helper.make_node("Sub", ["pre_gap", "pre_before"], ["pre_after"]),
+            helper.make_node("Concat", ["pre_zero2", "pre_before", "pre_zero2", "pre_after"], ["pre_pads_nchw"], axis=0),
+        ]
+        # pads above are ordered N,C,H,W; the tensor is N,H,W,C
+        graph.initializer.append(const("pre_pads_order", [0, 2, 3, 1, 4, 6, 7, 5], np.int64))
+        nodes += [
+            helper.make_node("Gather", ["pre_pads_nchw", "pre_pads_order"], ["pre_pads"], axis=0),
+            helper.make_node("Pad", ["pre_resized", "pre_pads", "pre_pad_value"], ["pre_padded"], mode="constant"),
+        ]
+        x = "pre_padded"
+
+    nodes += [
+        helper.make_node("Cast", [x], ["pre_float"], to=float_type),
+        helper.make_node("Transpose", ["pre_float"], ["pre_nchw"], perm=[0, 3, 1, 2]),
+    ]
+
+    weights = None
+    if not args.no_fold and len(consumers) == 1 and consumers[0].op_type == "Conv":
+        weight_name = consumers[0].input[1]
+        weights = next((t for t in graph.initializer if t.name == weight_name), None)
+        shared = sum(weight_name in node.input for node in graph.node) > 1
+        if shared:
+            weights = None
+    if weights is not None:
+        # conv(swap(x) / 255, W) == conv(x, swap(W) / 255); zero padding stays zero either way
+        w = numpy_helper.to_array(weights)
+        folded = (w[:, ::-1].astype(np.float64) / 255.0).astype(w.dtype)
+        weights.CopyFrom(numpy_helper.from_array(np.ascontiguousarray(folded), weight_name))
+        nodes.append(helper.make_node("Identity", ["pre_nchw"], [normalized]))
+    else:
+        graph.initializer.extend([const("pre_rgb", [2, 1, 0], np.int64), const("pre_scale", 1.0 / 255.0, np_float)])
+        nodes += [
+            helper.make_node("Gather", ["pre_nchw", "pre_rgb"], ["pre_rgb_nchw"], axis=1),
+            helper.make_node("Mul", ["pre_rgb_nchw", "pre_scale"], [normalized]),
+        ]
+
+    def dim(d):
+        return d.dim_param if d.dim_param else (d.dim_value if d.dim_value > 0 else None)
+
+    if args.letterbox:
+        shape = [dim(dims[0]), "height", "width", 3]
+    else:
+        shape = [dim(dims[0]), dim(dims[2]), dim(dims[3]), 3]
+    new_input = helper.make_tensor_value_info(name, TensorProto.UINT8, shape)
+    graph.input.remove(image)
+    graph.input.insert(0, new_input)
+
+    existing = list(graph.node)
+    del graph.node[:]
+    graph.node.extend(nodes + existing)
+
+    set_metadata(model, "preprocess", "uint8_bgr_hwc")
+    if args.letterbox:
+        set_metadata(model, "embedded_letterbox", "%dx%d" % (width, height))
+
+    onnx.checker.check_model(model)
+    onnx.save(model, args.output)
+    print("Saved %s: uint8 input %s, %s, %s" % (
+        args.output, shape, "letterbox %s inside" % args.letterbox if args.letterbox else "host letterbox",
+        "swap and scale folded into %s" % weights.name if weights is not None else "swap and scale as ops"))
+
+
+if __name__ == "__main__":
+    main()
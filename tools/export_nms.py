@@ -0,0 +1,124 @@
+"""Append decoding, NMS and top-k to an exported YOLOv8 ONNX model.
+
+The raw head output [1,4+nc(+32),A] is replaced by a compact [N,6(+32)] tensor of
+cx,cy,w,h,conf,class(,mask coeffs) rows, sorted by confidence. NMS is class-agnostic
+over each anchor's best class, the same as the C++ postprocessing. The mask
+prototype output of segmentation models is kept as is.
+
+    python tools/export_nms.py -i models/yolov8m.onnx -o models/yolov8m-nms.onnx
+"""
+import argparse
+
+import onnx
+from onnx import TensorProto, helper, numpy_helper
+import numpy as np
+
+
+def const(name, value, dtype):
+    return numpy_helper.from_array(np.array(value, dtype=dtype), name)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("-i", "--input", required=True, help="YOLOv8 ONNX model exported by ultralytics.")
+    parser.add_argument("-o", "--output", required=True, help="Path to save the rewritten model.")
+    parser.add_argument("--conf", type=float, default=0.25, help="Score threshold applied inside NMS.")
+    parser.add_argument("--iou", type=float, default=0.45, help="IoU threshold applied inside NMS.")
+    parser.add_argument("--max-det", type=int, default=300, help="Maximum detections kept after NMS.")
+    args = parser.parse_args()
+
+    model = onnx.load(args.input)
+    graph = model.graph
+    opset = next(o.version for o in model.opset_import if o.domain in ("", "ai.onnx"))
+
+    head = graph.output[0]
+    head_shape = [d.dim_value for d in head.type.tensor_type.shape.dim]
+    if len(head_shape) != 3:
+        raise SystemExit("output0 is not a raw YOLOv8 head: %s" % head_shape)
+    has_mask = len(graph.output) > 1
+    num_masks = graph.output[1].type.tensor_type.shape.dim[1].dim_value if has_mask else 0
+    num_classes = head_shape[1] - 4 - num_masks
+
+    graph.initializer.extend([
+        const("nms_box_starts", [0], np.int64), const("nms_box_ends", [4], np.int64),
+        const("nms_cls_starts", [4], np.int64), const("nms_cls_ends", [4 + num_classes], np.int64),
+        const("nms_mask_starts", [4 + num_classes], np.int64),
+        const("nms_mask_ends", [4 + num_classes + num_masks], np.int64),
+        const("nms_axis2", [2], np.int64),
+        const("nms_boxes_shape", [-1, 4], np.int64), const("nms_masks_shape", [-1, max(num_masks, 1)], np.int64),
+        const("nms_column_shape", [-1, 1], np.int64), const("nms_flat_shape", [-1], np.int64),
+        const("nms_max_output", [args.max_det], np.int64),
+        const("nms_iou", [args.iou], np.float32), const("nms_conf", [args.conf], np.float32),
+        const("nms_max_det", [args.max_det], np.int64), const("nms_box_column", 2, np.int64),
+    ])
+
+    if opset >= 18:
+        graph.initializer.append(const("nms_reduce_axes", [2], np.int64))
+        reduce_max = helper.make_node("ReduceMax", ["nms_scores", "nms_reduce_axes"], ["nms_best"], keepdims=1)
+    else:
+        reduce_max = helper.make_node("ReduceMax", ["nms_scores"], ["nms_best"], axes=[2], keepdims=1)
+
+    nodes = [
+        # [1,C,A] -> [1,A,C]
+        helper.make_node("Transpose", [head.name], ["nms_head"], perm=[0, 2, 1]),
+        helper.make_node("Slice", ["nms_head", "nms_box_starts", "nms_box_ends", "nms_axis2"], ["nms_boxes"]),
+        helper.make_node("Slice", ["nms_head", "nms_cls_starts", "nms_cls_ends", "nms_axis2"], ["nms_scores"]),
+        # best class per anchor, as getBestClassInfo does
+        reduce_max,
+        helper.make_node("ArgMax", ["nms_scores"], ["nms_class"], axis=2, keepdims=0),
+        helper.make_node("Transpose", ["nms_best"], ["nms_best_t"], perm=[0, 2, 1]),
+        helper.make_node("NonMaxSuppression",
+                         ["nms_boxes", "nms_best_t", "nms_max_output", "nms_iou", "nms_conf"],
+                         ["nms_selected"], center_point_box=1),
+        # selected rows are (batch, 0, anchor); keep the anchor index
+        helper.make_node("Gather", ["nms_selected", "nms_box_column"], ["nms_anchor"], axis=1),
+        helper.make_node("Reshape", ["nms_best", "nms_flat_shape"], ["nms_best_flat"]),
+        helper.make_node("Gather", ["nms_best_flat", "nms_anchor"], ["nms_kept_conf"], axis=0),
+        # top-k by confidence, k = min(kept, max_det)
+        helper.make_node("Shape", ["nms_kept_conf"], ["nms_kept_count"]),
+        helper.make_node("Min", ["nms_kept_count", "nms_max_det"], ["nms_k"]),
+        helper.make_node("TopK", ["nms_kept_conf", "nms_k"], ["nms_topk_conf", "nms_topk_idx"],
+                         axis=0, largest=1, sorted=1),
+        helper.make_node("Gather", ["nms_anchor", "nms_topk_idx"], ["nms_topk_anchor"], axis=0),
+        helper.make_node("Reshape", ["nms_boxes", "nms_boxes_shape"], ["nms_boxes_flat"]),
+        helper.make_node("Gather", ["nms_boxes_flat", "nms_topk_anchor"], ["nms_det_boxes"], axis=0),
+        helper.make_node("Reshape", ["nms_topk_conf", "nms_column_shape"], ["nms_det_conf"]),
+        helper.make_node("Reshape", ["nms_class", "nms_flat_shape"], ["nms_class_flat"]),
+        helper.make_node("Gather", ["nms_class_flat", "nms_topk_anchor"], ["nms_det_class_i"], axis=0),
+        helper.make_node("Cast", ["nms_det_class_i"], ["nms_det_class_f"], to=TensorProto.FLOAT),
+        helper.make_node("Reshape", ["nms_det_class_f", "nms_column_shape"], ["nms_det_class"]),
+    ]
+    columns = ["nms_det_boxes", "nms_det_conf", "nms_det_class"]
+    if has_mask:
+        nodes += [
+            helper.make_node("Slice", ["nms_head", "nms_mask_starts", "nms_mask_ends", "nms_axis2"], ["nms_masks"]),
+            helper.make_node("Reshape", ["nms_masks", "nms_masks_shape"], ["nms_masks_flat"]),
+            helper.make_node("Gather", ["nms_masks_flat", "nms_topk_anchor"], ["nms_det_masks"], axis=0),
+        ]
+        columns.append("nms_det_masks")
+    nodes.append(helper.make_node("Concat", columns, ["detections"], axis=1))
+    graph.node.extend(nodes)
+
+    detections = helper.make_tensor_value_info("detections", TensorProto.FLOAT, ["num_dets", 6 + num_masks])
+    outputs = [detections]
+    for output in graph.output[1:]:
+        kept = onnx.ValueInfoProto()
+        kept.CopyFrom(output)
+        outputs.append(kept)
+    del graph.output[:]
+    graph.output.extend(outputs)
+
+    for key, value in (("embedded_nms", "1"), ("num_classes", str(num_classes))):
+        entry = next((p for p in model.metadata_props if p.key == key), None)
+        if entry is None:
+            entry = model.metadata_props.add()
+        entry.key, entry.value = key, value
+
+    onnx.checker.check_model(model)
+    onnx.save(model, args.output)
+    print("Saved %s: detections [N,%d], %d classes, conf %.2f, iou %.2f, max_det %d"
+          % (args.output, 6 + num_masks, num_classes, args.conf, args.iou, args.max_det))
+
+
+if __name__ == "__main__":
+    main()
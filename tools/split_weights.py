@@ -0,0 +1,65 @@
+"""Move the initializers of an ONNX model into one weights file that sessions can share.
+
+Writes the model with its large initializers stored as external data, the weights file
+itself (every tensor 64-byte aligned) and an index next to it (<weights>.idx, one
+tab-separated line per tensor: name, ONNX element type, dims, offset, byte count).
+yolov8_serve --shared_weights maps the weights file once and hands the tensors to every
+session, so several instances of the model keep a single copy of the weights.
+
+    python tools/split_weights.py -i models/yolov8m.onnx -o models/yolov8m-split.onnx
+    ./build/yolov8_serve -m models/yolov8m-split.onnx --shared_weights models/yolov8m-split.weights --workers 4 --instances 4
+"""
+import argparse
+import os
+
+import onnx
+from onnx import TensorProto, numpy_helper
+from onnx.external_data_helper import set_external_data
+
+ALIGNMENT = 64
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("-i", "--input", required=True, help="ONNX model to split.")
+    parser.add_argument("-o", "--output", required=True, help="Path to save the model that references the weights file.")
+    parser.add_argument("--min-bytes", type=int, default=1024,
+                        help="Smaller initializers (shape constants and the like) stay inside the model.")
+    args = parser.parse_args()
+
+    model = onnx.load(args.input)
+    weights_path = os.path.splitext(args.output)[0] + ".weights"
+    location = os.path.basename(weights_path)
+
+    index = []
+    offset = 0
+    with open(weights_path, "wb") as weights:
+        for tensor in model.graph.initializer:
+            if tensor.data_type == TensorProto.STRING:
+                continue
+            array = numpy_helper.to_array(tensor)
+            data = array.astype(array.dtype.newbyteorder("<")).tobytes()
+            if len(data) < args.min_bytes:
+                continue
+            padding = -offset % ALIGNMENT
+            weights.write(b"\0" * padding)
+            offset += padding
+            weights.write(data)
+
+            # the split model stays loadable on its own: ORT reads the same bytes from the
+            # weights file when no shared tensors are supplied
+            tensor.CopyFrom(numpy_helper.from_array(array, tensor.name))
+            set_external_data(tensor, location, offset=offset, length=len(data))
+            tensor.ClearField("raw_data")
+            index.append("%s\t%d\t%s\t%d\t%d" % (tensor.name, tensor.data_type,
+                                                  ",".join(str(d) for d in tensor.dims), offset, len(data)))
+            offset += len(data)
+
+    with open(weights_path + ".idx", "w") as f:
+        f.write("\n".join(index) + "\n")
+    onnx.save(model, args.output)
+    print("%d initializers, %.1f MB -> %s" % (len(index), offset / 1e6, weights_path))
+
+
+if __name__ == "__main__":
+    main()